@@ -0,0 +1,78 @@
+#ifndef __EXECUTOR_H__
+#define __EXECUTOR_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+struct EXWorkerST;
+struct MemPoolST;
+
+/*
+	Work-stealing thread pool
+	Each worker thread owns a LUHandler deque. Jobs submitted by a job are
+	pushed to the head of its own worker's deque and popped from the head
+	again (LIFO, cache warm), jobs submitted by other threads are added to
+	the tail of a worker's deque in round robin. A worker with an empty
+	deque steals the oldest job from the tail of a random victim by
+	lu_pop_tail(), so workers only share a lock while stealing, instead of
+	all of them waiting on the listLock of one LU_TYPE_BLOCK_QUEUE.
+	Idle workers sleep on idleCond, submit only takes idleLock while some
+	worker is sleeping.
+*/
+typedef struct EXExecutorST {
+	int threadCount;
+	struct EXWorkerST* workers;
+	pthread_mutex_t idleLock;
+	pthread_cond_t idleCond;
+	int idleCount; // workers sleeping or about to sleep on idleCond, atomic
+	int leaveFlag; // set by ex_release_executor(), atomic
+	unsigned int submitSeq; // round robin worker for jobs from other threads, atomic
+	struct MemPoolST* jobPool; // EXJob allocator shared by all executors
+} EXExecutor;
+
+/*
+	jobctx, jobdata:
+		the user defined data pass by ex_submit()
+	function definition for job callback
+*/
+typedef void (*EXJobFunc)(void* jobctx, void* jobdata);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+	Create executor and start its worker threads
+	threadCount:
+		number of worker threads, <= 0 for number of online cpus
+	cpus:
+		pin worker i to cpus[i % cpuCount], NULL for no pinning(Linux only)
+	Return NULL for fail
+*/
+EXExecutor* ex_create_executor(int threadCount, const int* cpus, int cpuCount);
+
+/*
+	Run all submitted jobs, including the jobs they submit, then stop
+	worker threads and free executor
+	Other threads must stop submitting before it, don't call it in a job
+*/
+void ex_release_executor(EXExecutor* exec);
+
+/*
+	Submit a job, it can be called in any thread, and in a job
+	func:
+		invoked as func(jobctx, jobdata) in a worker thread
+	Return 0 for success, -1 for fail or executor is being released
+*/
+int ex_submit(EXExecutor* exec, EXJobFunc func, void* jobctx, void* jobdata);
+
+/*
+	Return number of jobs stolen from other workers, for tuning
+*/
+uint64_t ex_get_steal_count(EXExecutor* exec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,9 +2,14 @@
 #define __LIST_UTIL_H__
 
 #include <stdint.h>
+#include <stddef.h>
 #include <pthread.h>
 
 struct LUEntryST;
+struct MemPoolST;
+struct LURingST;
+struct LUHeapST;
+struct IdMapST;
 
 typedef struct {
 	int type; // LU_TYPE_xxx
@@ -13,9 +18,15 @@ typedef struct {
 	// waiting condition for lu_dequeue() in LU_TYPE_BLOCK_QUEUE
 	// waiting condition for lu_wait_notify() in LU_TYPE_LIST
 	pthread_cond_t listCond;
-	int leaveFlag;
+	int leaveFlag; // closed by lu_close()
+	int waiters; // threads blocked in lu_pop(), lu_release_list() waits them leave
     struct LUEntryST* head;
     struct LUEntryST* tail;
+	struct MemPoolST* entryPool; // LUEntry allocator shared by all lists, NULL for ring, priority and intrusive
+	struct LURingST* ring; // LU_TYPE_xxx_RING_xxx only, head/tail are not used
+	struct LUHeapST* heap; // LU_TYPE_xxx_PRIORITY only, head/tail are not used
+	struct IdMapST* keyIndex; // key to LUEntry, keyed list only
+	uint64_t (*keyFunc)(void* entrydata); // LUKeyFunc of keyed list
 } LUHandler;
 
 typedef struct LUEntryST {
@@ -24,6 +35,14 @@ typedef struct LUEntryST {
 	struct LUEntryST* prev;
 } LUEntry;
 
+/*
+	Entry embedded in user struct for LU_TYPE_INTRUSIVE list, added by
+	lu_add_node()/lu_push_node(), so list doesn't allocate LUEntry
+	LU_NODE_ENTRY() returns the user struct of node, like container_of()
+*/
+typedef LUEntry LUNode;
+#define LU_NODE_ENTRY(node, type, member)	((type*) ((char*) (node) - offsetof(type, member)))
+
 #define LU_IT_MATCH         1
 #define LU_IT_NOT_MATCH     0
 #define LU_IT_CONTINUE      0
@@ -33,11 +52,35 @@ typedef struct LUEntryST {
 
 #define LU_TYPE_NONBLOCK		0
 #define LU_TYPE_BLOCK			1
-#define LU_TYPE_LIST			(1<<1) | LU_TYPE_NONBLOCK
-#define LU_TYPE_NONBLOCK_QUEUE	(2<<1) | LU_TYPE_NONBLOCK
-#define LU_TYPE_BLOCK_QUEUE		(2<<1) | LU_TYPE_BLOCK
-#define LU_TYPE_NONBLOCK_STACK	(3<<1) | LU_TYPE_NONBLOCK
-#define LU_TYPE_BLOCK_STACK		(3<<1) | LU_TYPE_BLOCK
+#define LU_TYPE_LIST			((1<<1) | LU_TYPE_NONBLOCK)
+#define LU_TYPE_NONBLOCK_QUEUE	((2<<1) | LU_TYPE_NONBLOCK)
+#define LU_TYPE_BLOCK_QUEUE		((2<<1) | LU_TYPE_BLOCK)
+#define LU_TYPE_NONBLOCK_STACK	((3<<1) | LU_TYPE_NONBLOCK)
+#define LU_TYPE_BLOCK_STACK		((3<<1) | LU_TYPE_BLOCK)
+/*
+	Lock-free bounded FIFO ring, see lu_create_ring()
+	SPSC: one producer thread and one consumer thread
+	MPMC: any number of producer and consumer threads
+*/
+#define LU_TYPE_RING_SPSC		((4<<1) | LU_TYPE_NONBLOCK)
+#define LU_TYPE_BLOCK_RING_SPSC	((4<<1) | LU_TYPE_BLOCK)
+#define LU_TYPE_RING_MPMC		((5<<1) | LU_TYPE_NONBLOCK)
+#define LU_TYPE_BLOCK_RING_MPMC	((5<<1) | LU_TYPE_BLOCK)
+/*
+	Priority queue, see lu_create_priority()
+	lu_pop() returns the entry comes first by LUCompareFunc
+*/
+#define LU_TYPE_PRIORITY		((6<<1) | LU_TYPE_NONBLOCK)
+#define LU_TYPE_BLOCK_PRIORITY	((6<<1) | LU_TYPE_BLOCK)
+/*
+	Flag for LU_TYPE_LIST/QUEUE/STACK, e.g. LU_TYPE_BLOCK_QUEUE | LU_TYPE_INTRUSIVE
+	Entries are LUNode of user, added by lu_add_node()/lu_push_node() only.
+	The other functions work the same, entries popped or removed are not
+	freed, user owns the LUNode memory.
+*/
+#define LU_TYPE_INTRUSIVE		(1<<8)
+
+#define LU_RING_DEFAULT_CAPACITY	1024 // ring capacity of lu_create_list()
 
 /*
     function definition for iterator each entry in list
@@ -71,12 +114,60 @@ typedef char* (*LUDumpFunc)(void* entrydata, char* strBuf, int strBufLen);
 */
 typedef int (*LUMatchFunc)(void* entrydata, void* matchdata);
 
+/*
+    compare function for LU_TYPE_xxx_PRIORITY
+    entrydata1, entrydata2:
+        the user defined data pass by lu_add()
+    return < 0 if entrydata1 pops first, > 0 if entrydata2 pops first,
+    0 for same priority, entries of same priority pop in added order
+*/
+typedef int (*LUCompareFunc)(void* entrydata1, void* entrydata2);
+
+/*
+    key function for keyed list
+    entrydata:
+        the user defined data pass by lu_add()
+    return the 64-bit key of entrydata
+*/
+typedef uint64_t (*LUKeyFunc)(void* entrydata);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 LUHandler* lu_create_list(int type);
 
+/*
+    Create LU_TYPE_xxx_RING_xxx list with fixed capacity
+    capacity:
+        max entries in ring, round up to power of 2
+    Ring list only supports lu_enqueue()/lu_dequeue(), lu_is_empty() and lu_clear().
+    lu_enqueue() returns -1 immediately when ring is full.
+    lu_dequeue() of LU_TYPE_BLOCK_RING_xxx only sleeps while ring is empty.
+*/
+LUHandler* lu_create_ring(int type, int capacity);
+
+/*
+    Create LU_TYPE_xxx_PRIORITY list, a 4-ary heap ordered by cmpFunc
+    cmpFunc:
+        NULL for comparing entrydata as unsigned integer, smaller pops first
+    lu_add()/lu_push() are O(log n), lu_pop() family pops entries in
+    priority order in O(log n). lu_iterator(), lu_find() and lu_dump_list()
+    visit entries in heap order, not in priority order.
+    lu_create_list(LU_TYPE_xxx_PRIORITY) is the same as cmpFunc NULL.
+*/
+LUHandler* lu_create_priority(int type, LUCompareFunc cmpFunc);
+
+/*
+    Create LU_TYPE_LIST/QUEUE/STACK list with a hash index of entry keys,
+    lu_find_key()/lu_remove_key() are O(1) average instead of walking the
+    list, order of entries is the same as lu_create_list()
+    keyFunc:
+        keys must be unique in list, and not changed while entry is in list
+    Adding an entry whose key is already in list fails
+*/
+LUHandler* lu_create_keyed_list(int type, LUKeyFunc keyFunc);
+
 /*
     NOTE: you must free all entrydata before lu_release_list()
     We don't free entrydata while release_all_entry() because we have no default free callback.
@@ -85,6 +176,26 @@ LUHandler* lu_create_list(int type);
 */
 void lu_release_list(LUHandler* hdl);
 
+/*
+    Close list, adding to closed list fails and lu_pop() doesn't wait anymore
+    Threads blocked in lu_pop() are waked up, they get the remaining entries
+    or NULL
+*/
+void lu_close(LUHandler* hdl);
+
+/*
+    Return 1 for closed by lu_close(), else 0
+*/
+int lu_is_closed(LUHandler* hdl);
+
+/*
+    Preallocate memory for count entries, so adding and removing up to count
+    entries doesn't call malloc. Entry memory is shared by all lists and
+    kept for reuse, call it once after lu_create_list().
+    Return 0 for success, -1 for fail
+*/
+int lu_reserve_entries(LUHandler* hdl, int count);
+
 /*
     Return 1 for empty, else 0
 */
@@ -95,6 +206,13 @@ int lu_is_empty(LUHandler* hdl);
 */
 int lu_add(LUHandler* hdl, void* entrydata); // data for func
 
+/*
+    Add items to list->tail in one lock, and wake up consumers once
+    Return number of added items, less than n while ring is full or key is
+    already in keyed list, -1 for fail
+*/
+int lu_add_batch(LUHandler* hdl, void** items, int n);
+
 /*
     do function for each entry in taslist
     itdata:
@@ -103,7 +221,16 @@ int lu_add(LUHandler* hdl, void* entrydata); // data for func
 int lu_iterator(LUHandler* hdl, LUIteratorFunc func, void* itdata);
 
 /*
-    dump all entries in list
+    do function for each entry in a copy of list taken in one lock, func
+    runs without listLock, so dumps and statistics walks don't block adding
+    and popping threads
+    func returns LU_IT_CONTINUE or LU_IT_BREAK, entries can't be removed.
+    entrydata removed meanwhile is still passed to func, keep it valid.
+*/
+int lu_iterator_snapshot(LUHandler* hdl, LUIteratorFunc func, void* itdata);
+
+/*
+    dump all entries in list, by lu_iterator_snapshot()
 */
 int lu_dump_list(char* title, LUHandler* hdl, LUDumpFunc func);
 
@@ -125,8 +252,22 @@ void* lu_find(LUHandler* hdl, LUMatchFunc matchFunc, void* matchdata);
 */
 void* lu_remove(LUHandler* hdl, LUMatchFunc matchFunc, void* matchdata);
 
+/*
+    Keyed list only
+    Return the entrydata of key, NULL while not found
+*/
+void* lu_find_key(LUHandler* hdl, uint64_t key);
+
+/*
+    Keyed list only
+    if found, return the entrydata of key and remove the entry
+    return NULL while not found
+*/
+void* lu_remove_key(LUHandler* hdl, uint64_t key);
+
 /*
    push data to list->head for FILO
+   LU_TYPE_xxx_PRIORITY adds data by priority, same as lu_add()
 */
 int lu_push(LUHandler* hdl, void* entrydata);
 
@@ -135,6 +276,59 @@ int lu_push(LUHandler* hdl, void* entrydata);
 */
 void* lu_pop(LUHandler* hdl);
 
+/*
+    LU_TYPE_INTRUSIVE only, add node to list->tail without allocation
+    node:
+        embedded in user struct, not in any list, node->data is set to entrydata
+*/
+int lu_add_node(LUHandler* hdl, LUNode* node, void* entrydata);
+
+/*
+    LU_TYPE_INTRUSIVE only, add node to list->head without allocation
+*/
+int lu_push_node(LUHandler* hdl, LUNode* node, void* entrydata);
+
+/*
+    LU_TYPE_INTRUSIVE only, pop node from list->head, waits as lu_pop()
+    Return NULL while list is empty
+*/
+LUNode* lu_pop_node(LUHandler* hdl);
+
+/*
+    LU_TYPE_INTRUSIVE only, unlink node in O(1)
+    node:
+        must be in this list
+*/
+void lu_remove_node(LUHandler* hdl, LUNode* node);
+
+/*
+    Pop data from list->tail without waiting, the other end of lu_pop()
+    e.g. the owner uses lu_push()/lu_pop() and other threads steal the
+    oldest entry by lu_pop_tail()
+    Return NULL while list is empty
+*/
+void* lu_pop_tail(LUHandler* hdl);
+
+/*
+    Pop at most max entries from list->head in one lock
+    out:
+        output, at least max items
+    timeout:
+        usec. LU_TYPE_BLOCK_xxx waits once until list is not empty, notified or closed
+        (ring lists ignore lu_notify())
+        0 for no wait, -1 for wait forever
+    Return number of entries in out, 0 for timeout, lu_notify() or closed list is empty
+*/
+int lu_pop_batch(LUHandler* hdl, void** out, int max, int64_t timeout);
+
+/*
+    Pop data from list->head, LU_TYPE_BLOCK_xxx waits at most timeout
+    timeout:
+        usec. 0 for no wait, -1 for wait forever
+    Return NULL for timeout, lu_notify() or closed list is empty
+*/
+void* lu_pop_timed(LUHandler* hdl, int64_t timeout);
+
 /*
     Add data to list->tail for FIFO
 */
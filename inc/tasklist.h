@@ -6,16 +6,70 @@
 #include <pthread.h>
 
 struct TLTaskST;
+struct TLWheelST;
+struct TLWorkersST;
+struct EXExecutorST;
+struct TLPollST;
+struct TLStatsST;
+struct IdMapST;
+struct MemPoolST;
 
-typedef struct {
+/*
+	id of task returned by tl_add_task_ex()/tl_add_task_abstime_ex()
+	ids are never reused in a handler, 0 is invalid id
+*/
+typedef uint64_t TLTaskId;
+
+#define TL_SHARD_BITS	8
+#define TL_MAX_SHARDS	(1 << TL_SHARD_BITS) // low bits of TLTaskId is the shard index
+
+#define TL_TYPE_HEAP	0 // binary min-heap, O(log n) add/remove
+#define TL_TYPE_WHEEL	1 // hierarchical timing wheel in msec tick, O(1) add/remove
+						  // usec timers are rounded up to next msec tick
+
+typedef struct TaskListHandlerST {
+	int type; // TL_TYPE_xxx
 	int isRunning;
 	pthread_t loopThread;
 	pthread_mutex_t listLock;
 	pthread_cond_t listCond;
-	struct TLTaskST* minTask;
-	struct TLTaskST* tasklist;
+	pthread_cond_t doneCond; // broadcast when callback of task with id returns, see tl_cancel_task_sync(), or executor jobs are done
+	int syncWaiters; // threads waiting on doneCond
+	int taskCount; // number of pending tasks, not include tasks in inbox
+	int64_t waitTime; // usec of monotonic clock the loop is waiting for, atomic
+	int64_t slack; // usec, tasks may run up to slack late to share one wakeup, atomic
+	uint64_t wakeupCount; // times the loop woke up, atomic
+	int budgetTasks; // max tasks run in one loop iteration, 0 for no limit
+	int64_t budgetTime; // usec, max time of one loop iteration, 0 for no limit
+	struct TLTaskST* inbox; // lock-free stack of added tasks, moved to queue by listLock holder
+	struct TLTaskST* minTask; // TL_TYPE_HEAP only, always heap[0], NULL while empty
+	struct TLTaskST** heap; // TL_TYPE_HEAP, binary min-heap ordered by abstime
+	int heapSize;
+	int heapCapacity;
+	struct TLWheelST* wheel; // TL_TYPE_WHEEL
+	TLTaskId lastTaskId;
+	struct IdMapST* taskIds; // TLTaskId -> TLTask, only for tasks added with id
+	struct TLWorkersST* workers; // NULL for running tasks in loop thread
+	struct EXExecutorST* executor; // shared executor to run tasks, see tl_set_executor()
+	int executorPending; // tasks submitted to executor and not done, atomic
+	struct TLPollST* poll; // poll mode, see tl_get_poll_fd(), NULL for loop thread
+	struct TLStatsST* stats; // NULL while stats is not enabled, see tl_enable_stats()
+	struct MemPoolST* taskPool; // TLTask allocator shared by all handlers
+	// sharded handler, see tl_create_sharded_handler()
+	int shardIndex; // index in parent->shards
+	int shardCount;
+	struct TaskListHandlerST** shards; // NULL for not sharded
+	struct TaskListHandlerST* parent; // sharded handler that own this shard
 } TaskListHandler;
 
+/*
+	state of task, see tl_get_task_state()
+*/
+#define TL_TASK_PENDING		0 // waiting for its time, callback doesn't start
+#define TL_TASK_RUNNING		1 // callback is running
+#define TL_TASK_DONE		2 // callback returned, or task is cancelled or not found
+#define TL_TASK_CANCELLED	3 // internal, cancelled before or while callback is running
+
 /*
 	data:
 		the user defined data pass by tl_add_task()
@@ -26,10 +80,43 @@ typedef void* (*TLTaskFunc)(TaskListHandler *hdl, void* taskdata);
 typedef struct TLTaskST {
 	TLTaskFunc taskFunc;
 	void *taskdata;
-	int64_t abstime; // time from 1970
+	int64_t abstime; // usec of monotonic clock to invoke the callback function
+	TLTaskId taskId; // 0 while task is not added with id
+	int64_t period; // usec, 0 for one-shot task
+	int state; // TL_TASK_xxx, atomic
+	int queueIndex; // position in hdl->heap or slot of hdl->wheel, -1 while not queued
 	struct TLTaskST* next;
+	struct TLTaskST* prev; // TL_TYPE_WHEEL only
 } TLTask;
 
+/*
+	task description for tl_add_tasks_batch()
+*/
+typedef struct {
+	int64_t abstime; // msec from 1970. time to invoke the callback function
+	TLTaskFunc taskFunc; // callback function
+	void* taskdata; // data for func
+} TLTaskSpec;
+
+#define TL_STATS_BUCKETS	32 // bucket 0 for 0 usec, bucket i for [2^(i-1), 2^i) usec
+
+/*
+	stats returned by tl_get_stats(), counters are from tl_enable_stats()
+	sample twice to get adds/cancels/fires per second
+*/
+typedef struct {
+	int64_t elapsed; // usec since tl_enable_stats()
+	uint64_t adds; // tasks added
+	uint64_t cancels; // tasks cancelled by id
+	uint64_t fires; // callbacks invoked
+	uint64_t lockCount; // listLock taken by tl_xxx functions and loop
+	uint64_t lockContended; // listLock was held by other thread and had to wait
+	int taskCount; // queue depth, pending tasks
+	int maxTaskCount; // max queue depth
+	uint64_t lateness[TL_STATS_BUCKETS]; // histogram of callback start - task time, usec
+	uint64_t execTime[TL_STATS_BUCKETS]; // histogram of callback run time, usec
+} TLStats;
+
 #define TL_IT_MATCH			1
 #define TL_IT_NOT_MATCH		0
 #define TL_IT_CONTINUE		0
@@ -58,6 +145,26 @@ extern "C" {
 #endif
 
 TaskListHandler* tl_create_handler();
+
+/*
+	type:
+		TL_TYPE_HEAP or TL_TYPE_WHEEL
+	tl_create_handler() is the same as tl_create_handler_with_type(TL_TYPE_HEAP)
+*/
+TaskListHandler* tl_create_handler_with_type(int type);
+
+/*
+	Create handler that partitions tasks across shardCount sub-handlers,
+	each shard has its own lock, queue and loop thread.
+	All tl_xxx functions accept the returned handler and route to shards,
+	new tasks go to the shard of current cpu, tasks added with id go back
+	to their shard by id. Callbacks get the returned handler as hdl.
+	type:
+		TL_TYPE_HEAP or TL_TYPE_WHEEL, for every shard
+	shardCount:
+		number of shards, <= 0 for number of online cpus, max TL_MAX_SHARDS
+*/
+TaskListHandler* tl_create_sharded_handler(int type, int shardCount);
 void tl_release_handler(TaskListHandler* hdl);
 
 /*
@@ -75,25 +182,259 @@ int tl_start_task_loop_thread(TaskListHandler* hdl);
 */
 int tl_stop_task_loop_thread(TaskListHandler* hdl);
 
+/*
+	Switch handler to poll mode and return a fd to watch in caller's event
+	loop, instead of running a loop thread. The fd becomes readable when the
+	earliest task is due or tasks are changed, then call tl_process_expired().
+	The fd is an epoll fd of a timerfd armed at the earliest task time and an
+	eventfd written by tl_xxx functions that change it, it can be added to
+	caller's epoll/poll/select. It is closed by tl_release_handler().
+	Must not be used with tl_start_task_loop_thread() or sharded handler.
+	Linux only.
+	Return fd for success, -1 for fail
+*/
+int tl_get_poll_fd(TaskListHandler* hdl);
+
+/*
+	Run all due tasks in current thread(or dispatch them to workers) and
+	re-arm the poll fd, call it when poll fd is readable.
+	Return 0 for success, -1 for handler not in poll mode
+*/
+int tl_process_expired(TaskListHandler* hdl);
+
+/*
+	Run timeout tasks in worker threads, loop thread only does timekeeping
+	and dispatches tasks, so a slow task doesn't delay other tasks.
+	Must be called before tl_start_task_loop_thread()/tl_get_poll_fd().
+	workerCount:
+		number of worker threads, 0 for running tasks in loop thread(default)
+		for sharded handler, each shard has workerCount worker threads
+	cpus:
+		cpu id to pin workers, worker i runs on cpus[i % cpuCount]
+		NULL for no pinning
+	Return 0 for success, -1 for fail
+*/
+int tl_set_worker_threads(TaskListHandler* hdl, int workerCount, const int* cpus, int cpuCount);
+
+/*
+	Run timeout tasks in a work-stealing executor created by
+	ex_create_executor(), it can be shared by handlers and plain jobs.
+	Call it before tl_start_task_loop_thread()/tl_get_poll_fd(), it can't
+	be used with tl_set_worker_threads(). Stopping the loop waits for tasks
+	already submitted, executor must be released after the handler.
+	exec:
+		NULL for running tasks in loop thread again
+	for sharded handler, it is set to each shard
+	Return 0 for success, -1 for fail
+*/
+int tl_set_executor(TaskListHandler* hdl, struct EXExecutorST* exec);
+
+/*
+	Allow tasks to run up to slack later than their time, like Linux timer
+	slack. The loop sleeps until the earliest task time + slack, and runs all
+	tasks that are due at that time in one wakeup, so timers with close
+	deadlines don't wake the loop one by one.
+	slack:
+		usec, 0 for running each task at its time(default)
+		for sharded handler, it is set to each shard
+	Return 0 for success, -1 for fail
+*/
+int tl_set_timer_slack(TaskListHandler* hdl, int64_t slack);
+
+/*
+	Limit the work of one loop iteration. Timeout tasks always run earliest
+	first, when the loop is behind, it runs at most maxTasks of them or
+	stops after maxTime, then comes back at once to pick the earliest tasks
+	again, so a new added task that is due earlier doesn't wait for the
+	whole backlog. In poll mode, tl_process_expired() returns with the poll
+	fd readable again, so the caller's event loop gets its turn.
+	maxTasks:
+		0 for no limit(default)
+	maxTime:
+		usec, checked after each callback, 0 for no limit(default)
+	for sharded handler, it is set to each shard
+	Return 0 for success, -1 for fail
+*/
+int tl_set_run_budget(TaskListHandler* hdl, int maxTasks, int64_t maxTime);
+
+/*
+	Return the number of times the loop woke up since handler was created,
+	sample it twice to get wakeups per second
+	for sharded handler, it is the sum of all shards
+*/
+uint64_t tl_get_wakeup_count(TaskListHandler* hdl);
+
+/*
+	Start collecting stats of handler, the counters are per-thread and
+	updated without lock, the cost is a few atomic adds and two clock reads
+	per callback. Call it once after tl_create_handler(), stats can not be
+	disabled, memory is freed by tl_release_handler().
+	for sharded handler, it is enabled for each shard
+	Return 0 for success, -1 for fail
+*/
+int tl_enable_stats(TaskListHandler* hdl);
+
+/*
+	Sum the per-thread counters into stats
+	for sharded handler, it is the sum of all shards
+	Return 0 for success, -1 while stats is not enabled
+*/
+int tl_get_stats(TaskListHandler* hdl, TLStats* stats);
+
+/*
+	Preallocate memory for count tasks, so adding and removing up to count
+	tasks doesn't call malloc. Task memory is shared by all handlers and
+	kept for reuse, call it once after tl_create_handler().
+	for sharded handler, count is divided between shards
+	Return 0 for success, -1 for fail
+*/
+int tl_reserve_tasks(TaskListHandler* hdl, int count);
+
 /*
 	Add a new task to task list
+	The task is pushed to a lock-free inbox and moved to the queue by the loop
+	or the next tl_xxx function, listLock is only taken to wake up the loop
+	while the task is earlier than the time loop is waiting for.
 */
 int tl_add_task(TaskListHandler* hdl,
 			    int64_t timeout, // msec. time to invoke the callback function
 			    TLTaskFunc taskFunc, // timeout callback function
 			    void* taskdata); // data for func
 
+/*
+	abstime is msec from 1970, it is converted to monotonic clock when added,
+	so the task is not affected by later date change
+*/
 int tl_add_task_abstime(TaskListHandler* hdl,
 			    int64_t abstime, // msec. time to invoke the callback function
 			    TLTaskFunc taskFunc, // callback function
 			    void* taskdata); // data for func
+
+/*
+	Add a new task in usec resolution, for sub-millisecond timers
+*/
+int tl_add_task_us(TaskListHandler* hdl,
+			    int64_t timeout, // usec. relative time to invoke the callback function
+			    TLTaskFunc taskFunc, // timeout callback function
+			    void* taskdata); // data for func
+/*
+	Same as tl_add_task()/tl_add_task_abstime(), and return id of new task
+	taskId:
+		output, id for tl_cancel_task()/tl_reschedule_task(), NULL for not needed
+*/
+int tl_add_task_ex(TaskListHandler* hdl,
+			    int64_t timeout, // msec. time to invoke the callback function
+			    TLTaskFunc taskFunc, // timeout callback function
+			    void* taskdata, // data for func
+			    TLTaskId* taskId);
+
+int tl_add_task_abstime_ex(TaskListHandler* hdl,
+			    int64_t abstime, // msec. time to invoke the callback function
+			    TLTaskFunc taskFunc, // callback function
+			    void* taskdata, // data for func
+			    TLTaskId* taskId);
+
+int tl_add_task_us_ex(TaskListHandler* hdl,
+			    int64_t timeout, // usec. relative time to invoke the callback function
+			    TLTaskFunc taskFunc, // timeout callback function
+			    void* taskdata, // data for func
+			    TLTaskId* taskId);
+
+/*
+	Add n tasks at once, for scheduling a large number of timers
+	All tasks are pushed to the inbox together and the loop is waked up at
+	most once.
+	taskIds:
+		output, id of each task in specs order, NULL for not needed
+	Return 0 for success, -1 for fail and no task is added
+*/
+int tl_add_tasks_batch(TaskListHandler* hdl, const TLTaskSpec* specs, int n, TLTaskId* taskIds);
+
+/*
+	Add a task that is invoked every period until it is cancelled
+	The same task is re-armed after each run, next time is previous time +
+	period, so the schedule doesn't drift with callback time. Periods missed
+	by a late run are coalesced into one run, see tl_get_task_overrun().
+	A running periodic task can be cancelled by id, it is not re-armed after
+	the callback returns.
+	taskId:
+		output, id for tl_cancel_task()/tl_reschedule_task(), NULL for not needed
+	Return 0 for success, -1 for fail
+*/
+int tl_add_periodic_task(TaskListHandler* hdl,
+			    int64_t abstime, // msec from 1970. time of the first run
+			    int64_t period, // msec. interval between runs, > 0
+			    TLTaskFunc taskFunc, // callback function
+			    void* taskdata); // data for func
+
+int tl_add_periodic_task_ex(TaskListHandler* hdl,
+			    int64_t abstime, // msec from 1970. time of the first run
+			    int64_t period, // msec. interval between runs, > 0
+			    TLTaskFunc taskFunc, // callback function
+			    void* taskdata, // data for func
+			    TLTaskId* taskId);
+
+/*
+	Called in callback of periodic task
+	Return number of periods missed and coalesced into current run,
+	0 for on time run or one-shot task
+*/
+int64_t tl_get_task_overrun(void);
+
+/*
+	Remove task by id without walking the list
+	A task due but not started yet is cancelled too, its callback is never
+	invoked. A running periodic task is cancelled and not re-armed after
+	the callback returns. A running one-shot task can not be cancelled.
+	Return 0 for success, -1 while task is not found(already done or removed)
+	or callback of one-shot task has started
+*/
+int tl_cancel_task(TaskListHandler* hdl, TLTaskId taskId);
+
+/*
+	Same as tl_cancel_task(), and if the callback is running in other thread,
+	wait until it returns. When it returns, the callback is not running and
+	will never be invoked again whatever the return value is, so taskdata
+	can be freed.
+	Called in the callback of the task itself, it doesn't wait. Callbacks
+	must not wait for each other in different worker threads.
+	Return 0 for success, -1 while task is not found or callback of one-shot
+	task has started(and returned now)
+*/
+int tl_cancel_task_sync(TaskListHandler* hdl, TLTaskId taskId);
+
+/*
+	Return TL_TASK_PENDING, TL_TASK_RUNNING or TL_TASK_DONE
+	Task ids are never reused, so an id of finished or cancelled task
+	doesn't refer to a new task, its state is TL_TASK_DONE forever.
+*/
+int tl_get_task_state(TaskListHandler* hdl, TLTaskId taskId);
+
+/*
+	Change the time to invoke task by id
+	abstime:
+		msec from 1970. new time to invoke the callback function
+	Return 0 for success, -1 while task is not found(already done or removed)
+	or periodic task is running
+*/
+int tl_reschedule_task(TaskListHandler* hdl, TLTaskId taskId, int64_t abstime);
+
 /*
 	do function for each task in taslist
 */
 int tl_iterator_task(TaskListHandler* hdl, TLIteratorFunc func, void* itdata);
 
 /*
-	dump all tasks in tasklist
+	do function for each task in a copy of tasklist taken in one lock, func
+	runs without listLock, so dumps and statistics walks don't stall the loop
+	and adding threads. Each shard is copied in its own lock.
+	func returns TL_IT_CONTINUE or TL_IT_BREAK, tasks can't be removed.
+	Tasks may run or be cancelled meanwhile, their taskdata must stay valid.
+*/
+int tl_iterator_task_snapshot(TaskListHandler* hdl, TLIteratorFunc func, void* itdata);
+
+/*
+	dump all tasks in tasklist, by the same copy as tl_iterator_task_snapshot()
 */
 int tl_dump_tasks(char* title, TaskListHandler* hdl, TLDumpFunc func);
 
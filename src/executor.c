@@ -0,0 +1,317 @@
+#ifdef __linux__
+#define _GNU_SOURCE // pthread_setaffinity_np
+#include <sched.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define LOG_TAG "ex"
+#include "log.h"
+
+#include "executor.h"
+#include "listutil.h"
+#include "mempool.h"
+
+#ifdef _MSC_VER
+#define EX_THREAD_LOCAL	__declspec(thread)
+#else
+#define EX_THREAD_LOCAL	__thread
+#endif
+
+#define EX_CACHE_LINE	64
+
+typedef struct {
+	LUNode node; // linked in deque with the job as entrydata, so lu_pop()/lu_pop_tail() return the job
+	EXJobFunc func;
+	void* jobctx;
+	void* jobdata;
+} EXJob;
+
+struct EXWorkerST {
+	EXExecutor* exec;
+	int index;
+	pthread_t thread;
+	LUHandler* deque; // intrusive, owner pushes/pops head, thieves pop tail
+	unsigned int seed; // xorshift state to pick victim
+	uint64_t steals; // written by owner only
+	char pad[EX_CACHE_LINE]; // owner updates seed/steals, keep them off other workers' line
+};
+
+static EX_THREAD_LOCAL struct EXWorkerST* currentWorker; // worker of current thread, NULL for other threads
+
+////////////////////////////////////////////////////////////////////////////////
+// Executor Utility
+////////////////////////////////////////////////////////////////////////////////
+static void pin_worker(struct EXWorkerST* worker, const int* cpus, int cpuCount)
+{
+#ifdef __linux__
+	cpu_set_t cpuset;
+
+	if (!cpus || cpuCount <= 0) {
+		return;
+	}
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpus[worker->index % cpuCount], &cpuset);
+	if (pthread_setaffinity_np(worker->thread, sizeof(cpuset), &cpuset) != 0) {
+		LOGE("pin worker %d to cpu %d fail", worker->index, cpus[worker->index % cpuCount]);
+	}
+#endif
+}
+
+static unsigned int next_random(struct EXWorkerST* worker)
+{
+	unsigned int x = worker->seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	worker->seed = x;
+	return x;
+}
+
+/*
+	steal the oldest job from other workers, start from a random victim
+	return NULL while all deques are empty
+*/
+static EXJob* steal_job(struct EXWorkerST* worker)
+{
+	EXExecutor* exec = worker->exec;
+	EXJob* job;
+	int start, i, victim;
+
+	if (exec->threadCount <= 1) {
+		return NULL;
+	}
+	start = (int) (next_random(worker) % exec->threadCount);
+	for (i = 0; i < exec->threadCount; i++) {
+		victim = (start + i) % exec->threadCount;
+		if (victim == worker->index) {
+			continue;
+		}
+		job = (EXJob*) lu_pop_tail(exec->workers[victim].deque);
+		if (job) {
+			__atomic_add_fetch(&worker->steals, 1, __ATOMIC_RELAXED);
+			return job;
+		}
+	}
+	return NULL;
+}
+
+static int has_job(EXExecutor* exec)
+{
+	int i;
+
+	for (i = 0; i < exec->threadCount; i++) {
+		if (!lu_is_empty(exec->workers[i].deque)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+	sleep until there may be a job
+	idleCount is raised before deques are checked again, and submitter
+	checks idleCount after its job is added, so either the job is seen
+	here or submitter signals
+	return -1 while executor is released and there is no job
+*/
+static int wait_job(EXExecutor* exec)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&exec->idleLock);
+	__atomic_add_fetch(&exec->idleCount, 1, __ATOMIC_SEQ_CST);
+	while (!has_job(exec)) {
+		if (__atomic_load_n(&exec->leaveFlag, __ATOMIC_SEQ_CST)) {
+			ret = -1;
+			break;
+		}
+		pthread_cond_wait(&exec->idleCond, &exec->idleLock);
+	}
+	__atomic_sub_fetch(&exec->idleCount, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&exec->idleLock);
+	return ret;
+}
+
+static void* worker_loop(void* param)
+{
+	struct EXWorkerST* worker = (struct EXWorkerST*) param;
+	EXExecutor* exec = worker->exec;
+	EXJob* job;
+
+	currentWorker = worker;
+	while (1) {
+		job = (EXJob*) lu_pop(worker->deque);
+		if (!job) {
+			job = steal_job(worker);
+		}
+		if (!job) {
+			if (wait_job(exec) != 0) {
+				break;
+			}
+			continue;
+		}
+		job->func(job->jobctx, job->jobdata);
+		mempool_free(exec->jobPool, job);
+	}
+	currentWorker = NULL;
+	return NULL;
+}
+
+/*
+	wake up one sleeping worker, if there is
+*/
+static void wakeup_worker(EXExecutor* exec)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST); // job is added before idleCount is read
+	if (__atomic_load_n(&exec->idleCount, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&exec->idleLock);
+		pthread_cond_signal(&exec->idleCond);
+		pthread_mutex_unlock(&exec->idleLock);
+	}
+}
+
+/*
+	wait first count workers run all jobs and leave
+*/
+static void stop_workers(EXExecutor* exec, int count)
+{
+	int i;
+
+	// workers leave when they see leaveFlag and all deques are empty
+	__atomic_store_n(&exec->leaveFlag, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&exec->idleLock);
+	pthread_cond_broadcast(&exec->idleCond);
+	pthread_mutex_unlock(&exec->idleLock);
+	for (i = 0; i < count; i++) {
+		pthread_join(exec->workers[i].thread, NULL);
+	}
+}
+
+/*
+	free deques and executor, threads must be stopped
+*/
+static void free_executor(EXExecutor* exec)
+{
+	int i;
+
+	for (i = 0; i < exec->threadCount; i++) {
+		if (exec->workers[i].deque) {
+			lu_release_list(exec->workers[i].deque);
+		}
+	}
+	pthread_mutex_destroy(&exec->idleLock);
+	pthread_cond_destroy(&exec->idleCond);
+	free(exec->workers);
+	free(exec);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Executor Export Function
+////////////////////////////////////////////////////////////////////////////////
+EXExecutor* ex_create_executor(int threadCount, const int* cpus, int cpuCount)
+{
+	EXExecutor* exec;
+	struct EXWorkerST* worker;
+	int i;
+
+	if (threadCount <= 0) {
+		threadCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+		if (threadCount <= 0) {
+			threadCount = 1;
+		}
+	}
+	exec = (EXExecutor*) calloc(1, sizeof(EXExecutor));
+	if (!exec) {
+		return NULL;
+	}
+	pthread_mutex_init(&exec->idleLock, NULL);
+	pthread_cond_init(&exec->idleCond, NULL);
+	exec->threadCount = threadCount;
+	exec->workers = (struct EXWorkerST*) calloc(threadCount, sizeof(struct EXWorkerST));
+	exec->jobPool = mempool_shared(sizeof(EXJob));
+	if (!exec->workers || !exec->jobPool) {
+		exec->threadCount = 0;
+		free_executor(exec);
+		return NULL;
+	}
+	for (i = 0; i < threadCount; i++) {
+		worker = &exec->workers[i];
+		worker->exec = exec;
+		worker->index = i;
+		worker->seed = (unsigned int) i * 2654435761u + 1; // never 0 for xorshift
+		worker->deque = lu_create_list(LU_TYPE_NONBLOCK_STACK | LU_TYPE_INTRUSIVE);
+		if (!worker->deque) {
+			free_executor(exec);
+			return NULL;
+		}
+	}
+	for (i = 0; i < threadCount; i++) {
+		worker = &exec->workers[i];
+		if (pthread_create(&worker->thread, NULL, worker_loop, worker) != 0) {
+			LOGE("ex_create_executor: create worker %d fail", i);
+			stop_workers(exec, i);
+			free_executor(exec);
+			return NULL;
+		}
+		pin_worker(worker, cpus, cpuCount);
+	}
+	return exec;
+}
+
+void ex_release_executor(EXExecutor* exec)
+{
+	if (!exec)
+		return;
+	stop_workers(exec, exec->threadCount);
+	free_executor(exec);
+}
+
+int ex_submit(EXExecutor* exec, EXJobFunc func, void* jobctx, void* jobdata)
+{
+	struct EXWorkerST* worker = currentWorker;
+	EXJob* job;
+	int ret;
+
+	if (!func) {
+		return -1;
+	}
+	if (__atomic_load_n(&exec->leaveFlag, __ATOMIC_RELAXED) && !(worker && worker->exec == exec)) {
+		return -1; // jobs can still submit jobs while executor is released
+	}
+	job = (EXJob*) mempool_alloc(exec->jobPool);
+	if (!job) {
+		LOGE("ex_submit: job == NULL");
+		return -1;
+	}
+	job->func = func;
+	job->jobctx = jobctx;
+	job->jobdata = jobdata;
+
+	if (worker && worker->exec == exec) {
+		ret = lu_push_node(worker->deque, &job->node, job);
+	} else {
+		worker = &exec->workers[__atomic_fetch_add(&exec->submitSeq, 1, __ATOMIC_RELAXED) % exec->threadCount];
+		ret = lu_add_node(worker->deque, &job->node, job);
+	}
+	if (ret != 0) {
+		mempool_free(exec->jobPool, job);
+		return -1;
+	}
+	wakeup_worker(exec);
+	return 0;
+}
+
+uint64_t ex_get_steal_count(EXExecutor* exec)
+{
+	uint64_t count = 0;
+	int i;
+
+	for (i = 0; i < exec->threadCount; i++) {
+		count += __atomic_load_n(&exec->workers[i].steals, __ATOMIC_RELAXED);
+	}
+	return count;
+}
@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "idmap.h"
+
+#define IDMAP_MIN_CAPACITY	16
+
+////////////////////////////////////////////////////////////////////////////////
+// Id Map Utility
+////////////////////////////////////////////////////////////////////////////////
+/*
+	splitmix64 finalizer, spread sequential ids over all slots
+*/
+static uint64_t idmap_hash(uint64_t key)
+{
+	key ^= key >> 30;
+	key *= UINT64_C(0xbf58476d1ce4e5b9);
+	key ^= key >> 27;
+	key *= UINT64_C(0x94d049bb133111eb);
+	key ^= key >> 31;
+	return key;
+}
+
+/*
+	return slot index of key, or the empty slot to put key
+*/
+static int idmap_lookup(IdMap* map, uint64_t key)
+{
+	int mask = map->capacity - 1;
+	int idx = (int) (idmap_hash(key) & mask);
+
+	while (map->slots[idx].value && map->slots[idx].key != key) {
+		idx = (idx + 1) & mask;
+	}
+	return idx;
+}
+
+static int idmap_resize(IdMap* map, int capacity)
+{
+	IdMapSlot* oldSlots = map->slots;
+	int oldCapacity = map->capacity;
+	int i, idx;
+
+	map->slots = (IdMapSlot*) calloc(capacity, sizeof(IdMapSlot));
+	if (!map->slots) {
+		map->slots = oldSlots;
+		return -1;
+	}
+	map->capacity = capacity;
+	for (i = 0; i < oldCapacity; i++) {
+		if (oldSlots[i].value) {
+			idx = idmap_lookup(map, oldSlots[i].key);
+			map->slots[idx] = oldSlots[i];
+		}
+	}
+	free(oldSlots);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Id Map Export Function
+////////////////////////////////////////////////////////////////////////////////
+int idmap_init(IdMap* map, int capacity)
+{
+	int size = IDMAP_MIN_CAPACITY;
+
+	while (size < capacity) {
+		size *= 2;
+	}
+	memset(map, 0, sizeof(IdMap));
+	map->slots = (IdMapSlot*) calloc(size, sizeof(IdMapSlot));
+	if (!map->slots) {
+		return -1;
+	}
+	map->capacity = size;
+	return 0;
+}
+
+void idmap_destroy(IdMap* map)
+{
+	free(map->slots);
+	memset(map, 0, sizeof(IdMap));
+}
+
+void idmap_clear(IdMap* map)
+{
+	memset(map->slots, 0, map->capacity * sizeof(IdMapSlot));
+	map->count = 0;
+}
+
+void* idmap_get(IdMap* map, uint64_t key)
+{
+	return map->slots[idmap_lookup(map, key)].value;
+}
+
+int idmap_put(IdMap* map, uint64_t key, void* value)
+{
+	int idx;
+
+	// keep load factor under 3/4
+	if ((map->count + 1) * 4 > map->capacity * 3) {
+		if (idmap_resize(map, map->capacity * 2) != 0) {
+			return -1;
+		}
+	}
+	idx = idmap_lookup(map, key);
+	if (!map->slots[idx].value) {
+		map->count++;
+	}
+	map->slots[idx].key = key;
+	map->slots[idx].value = value;
+	return 0;
+}
+
+void* idmap_remove(IdMap* map, uint64_t key)
+{
+	int mask = map->capacity - 1;
+	int idx = idmap_lookup(map, key);
+	int next, home;
+	void* value = map->slots[idx].value;
+
+	if (!value) {
+		return NULL;
+	}
+	map->count--;
+	// shift following slots back, so lookup never stops at a hole
+	next = (idx + 1) & mask;
+	while (map->slots[next].value) {
+		home = (int) (idmap_hash(map->slots[next].key) & mask);
+		// move slot when its home is not in (idx, next]
+		if (((next - home) & mask) >= ((next - idx) & mask)) {
+			map->slots[idx] = map->slots[next];
+			idx = next;
+		}
+		next = (next + 1) & mask;
+	}
+	map->slots[idx].value = NULL;
+	map->slots[idx].key = 0;
+	return value;
+}
@@ -0,0 +1,60 @@
+#ifndef __ID_MAP_H__
+#define __ID_MAP_H__
+
+#include <stdint.h>
+
+/*
+	Internal open-addressing hash map from 64-bit id to pointer.
+	Linear probing with backward-shift deletion, so there is no tombstone.
+	A NULL value marks an empty slot, so NULL can not be stored.
+	Not thread safe, caller must hold its own lock.
+*/
+typedef struct {
+	uint64_t key;
+	void* value;
+} IdMapSlot;
+
+typedef struct IdMapST {
+	IdMapSlot* slots;
+	int capacity; // power of 2
+	int count;
+} IdMap;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+	capacity:
+		initial number of slots, round up to power of 2
+	return 0 for success, -1 for out of memory
+*/
+int idmap_init(IdMap* map, int capacity);
+void idmap_destroy(IdMap* map);
+
+/*
+	remove all keys, keep slots for reuse
+*/
+void idmap_clear(IdMap* map);
+
+/*
+	return the value of key, NULL while not found
+*/
+void* idmap_get(IdMap* map, uint64_t key);
+
+/*
+	add or replace the value of key
+	return 0 for success, -1 for out of memory
+*/
+int idmap_put(IdMap* map, uint64_t key, void* value);
+
+/*
+	return the removed value of key, NULL while not found
+*/
+void* idmap_remove(IdMap* map, uint64_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
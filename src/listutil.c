@@ -4,14 +4,20 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <string.h>
+#include <limits.h>
+#include <sched.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 #include "listutil.h"
+#include "mempool.h"
+#include "idmap.h"
 
 #define LOG_TAG "lu"
 #include "log.h"
 
-typedef int (*LUIteratorEntryFunc)(LUEntry* task, void* itdata);
-
 #define MAX_DUMP_STR_BUF_LEN    1024
 typedef struct {
     char strBuf[MAX_DUMP_STR_BUF_LEN];
@@ -22,7 +28,48 @@ typedef struct {
 ////////////////////////////////////////////////////////////////////////////////
 // List Utility
 ////////////////////////////////////////////////////////////////////////////////
-static int dump_entry(LUEntry* entry, void* dumpdata)
+#ifdef CLOCK_MONOTONIC
+#define LU_CLOCK	CLOCK_MONOTONIC
+#else
+#define LU_CLOCK	CLOCK_REALTIME
+#endif
+
+/*
+	usec of LU_CLOCK, listCond waits on this clock
+*/
+static int64_t get_clock_us(void)
+{
+	struct timespec ts;
+	clock_gettime(LU_CLOCK, &ts);
+
+	return ((int64_t) ts.tv_sec * 1000000) + ((int64_t) ts.tv_nsec / 1000);
+}
+
+static void us_to_timespec(int64_t us, struct timespec* ts)
+{
+	ts->tv_sec = us / 1000000;
+	ts->tv_nsec = (us % 1000000) * 1000;
+}
+
+static int is_closed(LUHandler* hdl)
+{
+	return __atomic_load_n(&hdl->leaveFlag, __ATOMIC_SEQ_CST);
+}
+
+/*
+	a blocking pop leaves, decrease waiters under listLock so the last one
+	can wake lu_release_list() waiting on listCond
+*/
+static void leave_wait(LUHandler* hdl)
+{
+	pthread_mutex_lock(&hdl->listLock);
+	if (__atomic_sub_fetch(&hdl->waiters, 1, __ATOMIC_SEQ_CST) == 0 && hdl->leaveFlag) {
+		pthread_cond_broadcast(&hdl->listCond);
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+}
+
+static int dump_entry(LUHandler* hdl, void* entrydata, void* dumpdata)
 {
     LuEntryDumpST* dumpst = (LuEntryDumpST*) dumpdata;
     char* str = NULL;
@@ -30,56 +77,786 @@ static int dump_entry(LUEntry* entry, void* dumpdata)
 
     if (dumpst->dumpFunc) {
         dumpst->strBuf[sizeof(dumpst->strBuf)-1] = '\0'; // null end of strBuf
-        str = dumpst->dumpFunc(entry->data, dumpst->strBuf, sizeof(dumpst->strBuf)-1); // -1 to avoid null end be overwrite
+        str = dumpst->dumpFunc(entrydata, dumpst->strBuf, sizeof(dumpst->strBuf)-1); // -1 to avoid null end be overwrite
     }
 
     if (str) {
-        LOGI("ENTRY %d(%p): %s", dumpst->count, entry, str);
+        LOGI("ENTRY %d(%p): %s", dumpst->count, entrydata, str);
     } else {
-        LOGI("ENTRY %d(%p): ", dumpst->count, entry);
+        LOGI("ENTRY %d(%p): ", dumpst->count, entrydata);
     }
     return 0;
 }
 
+/*
+    unlink entry from list, caller holds listLock
+*/
+static void unlink_entry(LUHandler* hdl, LUEntry* entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else { // first entry
+		hdl->head = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else { // tail entry
+		hdl->tail = entry->prev;
+	}
+}
+
+/*
+    entries of LU_TYPE_INTRUSIVE list are owned by user
+*/
+static void free_entry(LUHandler* hdl, LUEntry* entry)
+{
+	if (!(hdl->type & LU_TYPE_INTRUSIVE)) {
+		mempool_free(hdl->entryPool, entry);
+	}
+}
+
 static void release_all_entry(LUHandler* hdl)
 {
-    LUEntry *entry2free, *entry;
+	LUEntry* entry;
 
-    pthread_mutex_lock(&hdl->listLock);
-    entry = hdl->head;
-    while (entry) {
-        entry2free = entry;
-        entry = entry->next;
-        free(entry2free);
-    }
-    hdl->head = NULL;
-    hdl->tail = NULL;
-    pthread_mutex_unlock(&hdl->listLock);
+	pthread_mutex_lock(&hdl->listLock);
+	// entryPool is shared by all lists, give entries back one by one
+	while (hdl->head) {
+		entry = hdl->head;
+		hdl->head = entry->next;
+		free_entry(hdl, entry);
+	}
+	hdl->tail = NULL;
+	pthread_mutex_unlock(&hdl->listLock);
 }
 
 /*
-    do function for each task in taslist
+    add entry to keyIndex of keyed list, caller holds listLock
+    return 0 for success or not keyed list, -1 for key is in list or out of memory
 */
-static int iterator_entry(LUHandler* hdl, LUIteratorEntryFunc itfunc, void* itdata)
+static int index_entry(LUHandler* hdl, LUEntry* entry)
 {
-    int ret = 0;
-    LUEntry *entry;
+	uint64_t key;
 
-    if (!itfunc) {
-        return -1;
-    }
+	if (!hdl->keyIndex) {
+		return 0;
+	}
+	key = hdl->keyFunc(entry->data);
+	if (idmap_get(hdl->keyIndex, key)) {
+		return -1; // keys are unique
+	}
+	return idmap_put(hdl->keyIndex, key, entry);
+}
 
+/*
+    remove entry from keyIndex of keyed list, caller holds listLock
+*/
+static void unindex_entry(LUHandler* hdl, LUEntry* entry)
+{
+	if (hdl->keyIndex) {
+		idmap_remove(hdl->keyIndex, hdl->keyFunc(entry->data));
+	}
+}
+
+/*
+    add entry to list->head or list->tail, and wake up a consumer
+    return 0 for success, -1 for closed list or key is in keyed list
+*/
+static int link_entry(LUHandler* hdl, LUEntry* entry, int atHead)
+{
     pthread_mutex_lock(&hdl->listLock);
-    entry = hdl->head;
-    while (entry) {
-        ret = itfunc(entry, itdata);
-        if (ret == LU_IT_BREAK) {
-            break;
-        }
-        entry = entry->next;
+    if (hdl->leaveFlag || index_entry(hdl, entry) != 0) {
+        pthread_mutex_unlock(&hdl->listLock);
+        return -1;
+    }
+    if (!hdl->head) { // no head imply no tail, so fill it
+		hdl->head = entry;
+		hdl->tail = entry;
+		entry->prev = NULL;
+		entry->next = NULL;
+    } else if (atHead) {
+		hdl->head->prev = entry;
+		entry->next = hdl->head;
+		hdl->head = entry;
+		entry->prev = NULL;
+    } else {
+        hdl->tail->next = entry;
+		entry->prev = hdl->tail;
+		entry->next = NULL;
+		hdl->tail = entry;
     }
+	if (hdl->type & LU_TYPE_BLOCK)
+		pthread_cond_signal(&hdl->listCond);
     pthread_mutex_unlock(&hdl->listLock);
-    return ret;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Ring Utility
+////////////////////////////////////////////////////////////////////////////////
+#define LU_CACHE_LINE	64
+#define LU_RING_SPIN	64 // dequeue retries before sleeping, data usually comes soon
+
+#define LU_TYPE_KIND(type)	((type) & ~(LU_TYPE_BLOCK | LU_TYPE_INTRUSIVE))
+#define IS_RING_TYPE(type)	(LU_TYPE_KIND(type) == LU_TYPE_RING_SPSC || LU_TYPE_KIND(type) == LU_TYPE_RING_MPMC)
+
+typedef struct {
+	size_t seq; // MPMC: position the cell is ready for
+	void* data;
+} LURingCell;
+
+/*
+	producer and consumer positions are on their own cache line, so they
+	don't bounce between cores
+	MPMC is the bounded queue of Dmitry Vyukov, each cell has a sequence
+	number, so producers and consumers only CAS their own position.
+	SPSC only keeps positions, each side caches the other side position and
+	reloads it only when ring looks full/empty.
+*/
+struct LURingST {
+	char pad0[LU_CACHE_LINE];
+	size_t tail; // next position to enqueue
+	size_t headCache; // SPSC: head seen by producer
+	char pad1[LU_CACHE_LINE - 2 * sizeof(size_t)];
+	size_t head; // next position to dequeue
+	size_t tailCache; // SPSC: tail seen by consumer
+	char pad2[LU_CACHE_LINE - 2 * sizeof(size_t)];
+	int waitSeq; // futex word, changed for each wake up
+	int waiters; // consumers sleeping in ring_pop()
+	int spsc;
+	size_t mask; // capacity - 1
+	LURingCell cells[1];
+};
+
+static struct LURingST* ring_create(int type, int capacity)
+{
+	struct LURingST* ring;
+	size_t size = 2;
+	size_t i;
+
+	while (size < (size_t) capacity) {
+		size *= 2;
+	}
+	ring = (struct LURingST*) calloc(1, sizeof(struct LURingST) + (size - 1) * sizeof(LURingCell));
+	if (!ring) {
+		return NULL;
+	}
+	ring->mask = size - 1;
+	ring->spsc = (LU_TYPE_KIND(type) == LU_TYPE_RING_SPSC);
+	for (i = 0; i < size; i++) {
+		ring->cells[i].seq = i;
+	}
+	return ring;
+}
+
+/*
+	return 0 for success, -1 for full
+*/
+static int ring_enqueue(struct LURingST* ring, void* data)
+{
+	LURingCell* cell;
+	size_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	size_t seq;
+	intptr_t diff;
+
+	if (ring->spsc) {
+		if (pos - ring->headCache > ring->mask) {
+			ring->headCache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+			if (pos - ring->headCache > ring->mask) {
+				return -1;
+			}
+		}
+		ring->cells[pos & ring->mask].data = data;
+		__atomic_store_n(&ring->tail, pos + 1, __ATOMIC_RELEASE);
+		return 0;
+	}
+
+	while (1) {
+		cell = &ring->cells[pos & ring->mask];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		diff = (intptr_t) seq - (intptr_t) pos;
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) { // cell is not dequeued yet, full
+			return -1;
+		} else {
+			pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+		}
+	}
+	cell->data = data;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*
+	return 0 for success, -1 for empty and *data is not changed
+*/
+static int ring_dequeue(struct LURingST* ring, void** data)
+{
+	LURingCell* cell;
+	size_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	size_t seq;
+	intptr_t diff;
+
+	if (ring->spsc) {
+		if (pos == ring->tailCache) {
+			ring->tailCache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+			if (pos == ring->tailCache) {
+				return -1;
+			}
+		}
+		*data = ring->cells[pos & ring->mask].data;
+		__atomic_store_n(&ring->head, pos + 1, __ATOMIC_RELEASE);
+		return 0;
+	}
+
+	while (1) {
+		cell = &ring->cells[pos & ring->mask];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		diff = (intptr_t) seq - (intptr_t) (pos + 1);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) { // cell is not enqueued yet, empty
+			return -1;
+		} else {
+			pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		}
+	}
+	*data = cell->data;
+	// ready for the enqueue of next round
+	__atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int ring_is_empty(struct LURingST* ring)
+{
+	return (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) ==
+			__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))? 1: 0;
+}
+
+/*
+	wake up at most count consumers sleeping in ring_park(), INT_MAX for all
+*/
+static void ring_wake(LUHandler* hdl, int count)
+{
+	struct LURingST* ring = hdl->ring;
+
+	__atomic_add_fetch(&ring->waitSeq, 1, __ATOMIC_SEQ_CST);
+#ifdef __linux__
+	syscall(SYS_futex, &ring->waitSeq, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+#else
+	pthread_mutex_lock(&hdl->listLock);
+	if (count > 1) {
+		pthread_cond_broadcast(&hdl->listCond);
+	} else {
+		pthread_cond_signal(&hdl->listCond);
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+#endif
+}
+
+/*
+	sleep until ring_wake(), return immediately if waitSeq is not seq anymore
+	deadline:
+		usec of LU_CLOCK, -1 for no timeout
+	return -1 while deadline is passed, else 0
+*/
+static int ring_park(LUHandler* hdl, int seq, int64_t deadline)
+{
+	struct LURingST* ring = hdl->ring;
+	struct timespec ts;
+	int64_t now;
+
+	if (deadline >= 0) {
+		now = get_clock_us();
+		if (now >= deadline) {
+			return -1;
+		}
+	}
+#ifdef __linux__
+	// FUTEX_WAIT timeout is relative
+	if (deadline >= 0) {
+		us_to_timespec(deadline - now, &ts);
+	}
+	syscall(SYS_futex, &ring->waitSeq, FUTEX_WAIT_PRIVATE, seq, (deadline >= 0)? &ts: NULL, NULL, 0);
+#else
+	pthread_mutex_lock(&hdl->listLock);
+	if (__atomic_load_n(&ring->waitSeq, __ATOMIC_SEQ_CST) == seq) {
+		if (deadline >= 0) {
+			us_to_timespec(deadline, &ts);
+			pthread_cond_timedwait(&hdl->listCond, &hdl->listLock, &ts);
+		} else {
+			pthread_cond_wait(&hdl->listCond, &hdl->listLock);
+		}
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+#endif
+	return 0;
+}
+
+static int ring_add(LUHandler* hdl, void* entrydata)
+{
+	struct LURingST* ring = hdl->ring;
+
+	if (is_closed(hdl) || ring_enqueue(ring, entrydata) != 0) {
+		return -1;
+	}
+	if (hdl->type & LU_TYPE_BLOCK) {
+		// pairs with the fence in ring_pop(), either consumer sees the data
+		// or producer sees the waiter
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ring->waiters, __ATOMIC_RELAXED) > 0) {
+			ring_wake(hdl, 1);
+		}
+	}
+	return 0;
+}
+
+/*
+	return number of added items, stop at the first full slot
+*/
+static int ring_add_batch(LUHandler* hdl, void** items, int n)
+{
+	struct LURingST* ring = hdl->ring;
+	int count = 0;
+
+	if (is_closed(hdl)) {
+		return -1;
+	}
+	while (count < n && ring_enqueue(ring, items[count]) == 0) {
+		count++;
+	}
+	if (count > 0 && (hdl->type & LU_TYPE_BLOCK)) {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ring->waiters, __ATOMIC_RELAXED) > 0) {
+			ring_wake(hdl, count);
+		}
+	}
+	return count;
+}
+
+/*
+	same as lu_pop(), blocking consumer waits once and returns NULL if ring
+	is still empty after wake up
+*/
+static void* ring_pop(LUHandler* hdl)
+{
+	struct LURingST* ring = hdl->ring;
+	void* data = NULL;
+	int got;
+	int seq;
+	int i;
+
+	if (ring_dequeue(ring, &data) == 0 || !(hdl->type & LU_TYPE_BLOCK)) {
+		return data;
+	}
+
+	__atomic_add_fetch(&hdl->waiters, 1, __ATOMIC_SEQ_CST);
+	// sleeping costs two syscalls and makes producer call ring_wake()
+	got = -1;
+	for (i = 0; i < LU_RING_SPIN && got != 0 && !is_closed(hdl); i++) {
+		sched_yield();
+		got = ring_dequeue(ring, &data);
+	}
+	if (got != 0 && !is_closed(hdl)) {
+		seq = __atomic_load_n(&ring->waitSeq, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+		// pairs with the fence in ring_add()
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (ring_dequeue(ring, &data) != 0 && !is_closed(hdl)) {
+			ring_park(hdl, seq, -1);
+			ring_dequeue(ring, &data);
+		}
+		__atomic_sub_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+	}
+	leave_wait(hdl); // hdl may be released after this
+	return data;
+}
+
+/*
+	blocking consumer waits until ring is not empty, closed or deadline
+*/
+static int ring_pop_batch(LUHandler* hdl, void** out, int max, int64_t timeout)
+{
+	struct LURingST* ring = hdl->ring;
+	int64_t deadline = (timeout > 0)? get_clock_us() + timeout: -1;
+	int block = ((hdl->type & LU_TYPE_BLOCK) && timeout != 0);
+	int count = 0;
+	int timedout = 0;
+	int seq;
+
+	if (block) {
+		__atomic_add_fetch(&hdl->waiters, 1, __ATOMIC_SEQ_CST);
+	}
+	while (1) {
+		while (count < max && ring_dequeue(ring, &out[count]) == 0) {
+			count++;
+		}
+		if (count > 0 || timedout || !block || is_closed(hdl)) {
+			break;
+		}
+		seq = __atomic_load_n(&ring->waitSeq, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (ring_is_empty(ring) && !is_closed(hdl)) {
+			timedout = (ring_park(hdl, seq, deadline) != 0);
+		}
+		__atomic_sub_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+	}
+	if (block) {
+		leave_wait(hdl); // hdl may be released after this
+	}
+	return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Priority Utility
+////////////////////////////////////////////////////////////////////////////////
+#define LU_HEAP_ARITY		4 // shallower than binary heap, siblings share a cache line
+#define LU_HEAP_MIN_CAPACITY	16
+
+#define IS_PRIORITY_TYPE(type)	(LU_TYPE_KIND(type) == LU_TYPE_PRIORITY)
+
+typedef struct {
+	void* data;
+	uint64_t seq; // added order, entries of same priority pop in FIFO
+} LUHeapCell;
+
+/*
+	array based d-ary heap, cells[0] pops first, protected by listLock
+*/
+struct LUHeapST {
+	LUHeapCell* cells;
+	int count;
+	int capacity;
+	uint64_t seq; // seq of the next added entry
+	LUCompareFunc cmp; // NULL for comparing entrydata as unsigned integer
+};
+
+static struct LUHeapST* heap_create(void)
+{
+	return (struct LUHeapST*) calloc(1, sizeof(struct LUHeapST));
+}
+
+static void heap_release(struct LUHeapST* heap)
+{
+	if (heap) {
+		free(heap->cells);
+		free(heap);
+	}
+}
+
+/*
+	grow cells to hold at least capacity entries
+	return 0 for success, -1 for out of memory
+*/
+static int heap_reserve(struct LUHeapST* heap, int capacity)
+{
+	LUHeapCell* cells;
+	int size = heap->capacity * 2;
+
+	if (capacity <= heap->capacity) {
+		return 0;
+	}
+	if (size < LU_HEAP_MIN_CAPACITY) {
+		size = LU_HEAP_MIN_CAPACITY;
+	}
+	if (size < capacity) {
+		size = capacity;
+	}
+	cells = (LUHeapCell*) realloc(heap->cells, size * sizeof(LUHeapCell));
+	if (!cells) {
+		return -1;
+	}
+	heap->cells = cells;
+	heap->capacity = size;
+	return 0;
+}
+
+/*
+	return 1 if cell a pops before cell b
+*/
+static int heap_before(struct LUHeapST* heap, LUHeapCell* a, LUHeapCell* b)
+{
+	int ret;
+
+	if (heap->cmp) {
+		ret = heap->cmp(a->data, b->data);
+	} else {
+		ret = ((uintptr_t) a->data > (uintptr_t) b->data) - ((uintptr_t) a->data < (uintptr_t) b->data);
+	}
+	if (ret != 0) {
+		return ret < 0;
+	}
+	return a->seq < b->seq;
+}
+
+static void heap_sift_up(struct LUHeapST* heap, int i)
+{
+	LUHeapCell cell = heap->cells[i];
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / LU_HEAP_ARITY;
+		if (!heap_before(heap, &cell, &heap->cells[parent])) {
+			break;
+		}
+		heap->cells[i] = heap->cells[parent];
+		i = parent;
+	}
+	heap->cells[i] = cell;
+}
+
+static void heap_sift_down(struct LUHeapST* heap, int i)
+{
+	LUHeapCell cell = heap->cells[i];
+	int child, last, best;
+
+	while (1) {
+		child = i * LU_HEAP_ARITY + 1;
+		if (child >= heap->count) {
+			break;
+		}
+		last = child + LU_HEAP_ARITY;
+		if (last > heap->count) {
+			last = heap->count;
+		}
+		// the first of children
+		for (best = child++; child < last; child++) {
+			if (heap_before(heap, &heap->cells[child], &heap->cells[best])) {
+				best = child;
+			}
+		}
+		if (!heap_before(heap, &heap->cells[best], &cell)) {
+			break;
+		}
+		heap->cells[i] = heap->cells[best];
+		i = best;
+	}
+	heap->cells[i] = cell;
+}
+
+/*
+	rebuild heap after cells are changed in place
+*/
+static void heap_heapify(struct LUHeapST* heap)
+{
+	int i;
+
+	for (i = (heap->count - 2) / LU_HEAP_ARITY; i >= 0 && heap->count > 1; i--) {
+		heap_sift_down(heap, i);
+	}
+}
+
+/*
+	return 0 for success, -1 for out of memory
+*/
+static int heap_insert(struct LUHeapST* heap, void* data)
+{
+	if (heap_reserve(heap, heap->count + 1) != 0) {
+		return -1;
+	}
+	heap->cells[heap->count].data = data;
+	heap->cells[heap->count].seq = heap->seq++;
+	heap->count++;
+	heap_sift_up(heap, heap->count - 1);
+	return 0;
+}
+
+/*
+	remove cells[i] and return its data
+*/
+static void* heap_remove_at(struct LUHeapST* heap, int i)
+{
+	void* data = heap->cells[i].data;
+
+	heap->count--;
+	if (i < heap->count) {
+		// move the last cell to the hole, it may go either way
+		heap->cells[i] = heap->cells[heap->count];
+		if (i > 0 && heap_before(heap, &heap->cells[i], &heap->cells[(i - 1) / LU_HEAP_ARITY])) {
+			heap_sift_up(heap, i);
+		} else {
+			heap_sift_down(heap, i);
+		}
+	}
+	return data;
+}
+
+/*
+	add items in one lock, and wake up consumers once
+	return n for success, -1 for fail
+*/
+static int heap_add(LUHandler* hdl, void** items, int n)
+{
+	struct LUHeapST* heap = hdl->heap;
+	int i;
+
+	pthread_mutex_lock(&hdl->listLock);
+	if (hdl->leaveFlag || heap_reserve(heap, heap->count + n) != 0) {
+		pthread_mutex_unlock(&hdl->listLock);
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		heap_insert(heap, items[i]); // reserved, never fails
+	}
+	if (hdl->type & LU_TYPE_BLOCK) {
+		if (n > 1) {
+			pthread_cond_broadcast(&hdl->listCond);
+		} else {
+			pthread_cond_signal(&hdl->listCond);
+		}
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+	return n;
+}
+
+/*
+	same as lu_pop_batch(), entries are popped in priority order
+*/
+static int heap_pop_batch(LUHandler* hdl, void** out, int max, int64_t timeout)
+{
+	struct LUHeapST* heap = hdl->heap;
+	struct timespec ts;
+	int count = 0;
+	int waited = 0;
+
+	if (timeout > 0) {
+		us_to_timespec(get_clock_us() + timeout, &ts);
+	}
+
+	pthread_mutex_lock(&hdl->listLock);
+	if (hdl->type & LU_TYPE_BLOCK) {
+		// wait once like pop_entry(), lu_notify() wakes it up too
+		if (heap->count == 0 && timeout != 0 && hdl->leaveFlag == 0) {
+			waited = 1;
+			__atomic_add_fetch(&hdl->waiters, 1, __ATOMIC_SEQ_CST);
+			if (timeout < 0) {
+				pthread_cond_wait(&hdl->listCond, &hdl->listLock);
+			} else {
+				pthread_cond_timedwait(&hdl->listCond, &hdl->listLock, &ts);
+			}
+		}
+	}
+	while (count < max && heap->count > 0) {
+		out[count++] = heap_remove_at(heap, 0);
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+
+	if (waited) {
+		leave_wait(hdl); // hdl may be released after this
+	}
+	return count;
+}
+
+/*
+	same as lu_iterator(), entries are visited in heap order
+	removed cells are compacted out, then heap is rebuilt once
+*/
+static int heap_iterator(LUHandler* hdl, LUIteratorFunc itfunc, void* itdata)
+{
+	struct LUHeapST* heap = hdl->heap;
+	int ret = 0;
+	int stop = 0;
+	int i, kept;
+
+	pthread_mutex_lock(&hdl->listLock);
+	for (i = 0, kept = 0; i < heap->count; i++) {
+		if (!stop) {
+			ret = itfunc(hdl, heap->cells[i].data, itdata);
+			stop = (ret == LU_IT_BREAK || ret == LU_IT_REMOVE_BREAK);
+			if (ret == LU_IT_REMOVE || ret == LU_IT_REMOVE_BREAK) {
+				continue;
+			}
+		}
+		heap->cells[kept++] = heap->cells[i];
+	}
+	if (kept < heap->count) {
+		heap->count = kept;
+		heap_heapify(heap);
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+	return ret;
+}
+
+/*
+	same as lu_find()/lu_remove()
+*/
+static void* heap_match(LUHandler* hdl, LUMatchFunc matchFunc, void* matchdata, int remove)
+{
+	struct LUHeapST* heap = hdl->heap;
+	void* retdata = NULL;
+	int i;
+
+	pthread_mutex_lock(&hdl->listLock);
+	for (i = 0; i < heap->count; i++) {
+		if (matchFunc(heap->cells[i].data, matchdata) == LU_IT_MATCH) {
+			retdata = remove? heap_remove_at(heap, i): heap->cells[i].data;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+	return retdata;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Snapshot Utility
+////////////////////////////////////////////////////////////////////////////////
+#define LU_SNAPSHOT_MIN_CAPACITY	64
+
+/*
+	copy entrydata of all entries in one lock, list order for list types
+	and heap order for LU_TYPE_xxx_PRIORITY
+	out:
+		output, array of entrydata, free it by caller
+	return number of entries, -1 for out of memory
+*/
+static int snapshot_entries(LUHandler* hdl, void*** out)
+{
+	LUEntry* entry;
+	void** items = NULL;
+	void** grown;
+	int count = 0;
+	int capacity = 0;
+	int i;
+
+	pthread_mutex_lock(&hdl->listLock);
+	if (hdl->heap) {
+		if (hdl->heap->count > 0) {
+			items = (void**) malloc(hdl->heap->count * sizeof(void*));
+			if (!items) {
+				pthread_mutex_unlock(&hdl->listLock);
+				return -1;
+			}
+		}
+		for (i = 0; i < hdl->heap->count; i++) {
+			items[count++] = hdl->heap->cells[i].data;
+		}
+	} else {
+		// list doesn't keep its length, grow while walking
+		for (entry = hdl->head; entry; entry = entry->next) {
+			if (count == capacity) {
+				capacity = capacity? capacity * 2: LU_SNAPSHOT_MIN_CAPACITY;
+				grown = (void**) realloc(items, capacity * sizeof(void*));
+				if (!grown) {
+					pthread_mutex_unlock(&hdl->listLock);
+					free(items);
+					return -1;
+				}
+				items = grown;
+			}
+			items[count++] = entry->data;
+		}
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+	*out = items;
+	return count;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -90,13 +867,117 @@ static int iterator_entry(LUHandler* hdl, LUIteratorEntryFunc itfunc, void* itda
 */
 LUHandler* lu_create_list(int type)
 {
-    LUHandler* hdl = (LUHandler*) malloc(sizeof(LUHandler));
+    LUHandler* hdl;
+
+    if ((type & LU_TYPE_INTRUSIVE) && (IS_RING_TYPE(type) || IS_PRIORITY_TYPE(type))) {
+        LOGE("lu_create_list: LU_TYPE_INTRUSIVE is for list, queue and stack only");
+        return NULL;
+    }
+    hdl = (LUHandler*) malloc(sizeof(LUHandler));
     if (!hdl)
         return NULL;
     memset(hdl, 0, sizeof(LUHandler));
 	hdl->type = type;
+	if (IS_RING_TYPE(type)) {
+		hdl->ring = ring_create(type, LU_RING_DEFAULT_CAPACITY);
+		if (!hdl->ring) {
+			free(hdl);
+			return NULL;
+		}
+	} else if (IS_PRIORITY_TYPE(type)) {
+		hdl->heap = heap_create();
+		if (!hdl->heap) {
+			free(hdl);
+			return NULL;
+		}
+	} else if (!(type & LU_TYPE_INTRUSIVE)) {
+		// only linked entries allocate from the pool
+		hdl->entryPool = mempool_shared(sizeof(LUEntry));
+		if (!hdl->entryPool) {
+			free(hdl);
+			return NULL;
+		}
+	}
     pthread_mutex_init(&hdl->listLock, NULL);
+#ifdef WIN32
 	pthread_cond_init(&hdl->listCond, NULL);
+#else
+	{
+		// timed waits use LU_CLOCK deadline
+		pthread_condattr_t attr;
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, LU_CLOCK);
+		pthread_cond_init(&hdl->listCond, &attr);
+		pthread_condattr_destroy(&attr);
+	}
+#endif
+    return hdl;
+}
+
+/*
+    return NULL for fail
+*/
+LUHandler* lu_create_ring(int type, int capacity)
+{
+    LUHandler* hdl;
+
+    if (!IS_RING_TYPE(type) || capacity <= 0) {
+        LOGE("lu_create_ring: invalid type %d or capacity %d", type, capacity);
+        return NULL;
+    }
+    hdl = lu_create_list(type);
+    if (hdl && capacity != LU_RING_DEFAULT_CAPACITY) {
+        free(hdl->ring);
+        hdl->ring = ring_create(type, capacity);
+        if (!hdl->ring) {
+            lu_release_list(hdl);
+            return NULL;
+        }
+    }
+    return hdl;
+}
+
+/*
+    return NULL for fail
+*/
+LUHandler* lu_create_priority(int type, LUCompareFunc cmpFunc)
+{
+    LUHandler* hdl;
+
+    if (!IS_PRIORITY_TYPE(type)) {
+        LOGE("lu_create_priority: invalid type %d", type);
+        return NULL;
+    }
+    hdl = lu_create_list(type);
+    if (hdl) {
+        hdl->heap->cmp = cmpFunc;
+    }
+    return hdl;
+}
+
+/*
+    return NULL for fail
+*/
+LUHandler* lu_create_keyed_list(int type, LUKeyFunc keyFunc)
+{
+    LUHandler* hdl;
+
+    if (!keyFunc || IS_RING_TYPE(type) || IS_PRIORITY_TYPE(type)) {
+        LOGE("lu_create_keyed_list: invalid type %d or keyFunc", type);
+        return NULL;
+    }
+    hdl = lu_create_list(type);
+    if (!hdl) {
+        return NULL;
+    }
+    hdl->keyIndex = (struct IdMapST*) malloc(sizeof(IdMap));
+    if (!hdl->keyIndex || idmap_init(hdl->keyIndex, 0) != 0) {
+        free(hdl->keyIndex);
+        hdl->keyIndex = NULL;
+        lu_release_list(hdl);
+        return NULL;
+    }
+    hdl->keyFunc = keyFunc;
     return hdl;
 }
 
@@ -108,33 +989,89 @@ LUHandler* lu_create_list(int type)
 */
 void lu_release_list(LUHandler* hdl)
 {
-    if (!hdl)
-        return;
-    release_all_entry(hdl);
-	
+	if (!hdl) {
+		return;
+	}
+	lu_close(hdl);
+	// threads blocked in lu_pop() are waked up by lu_close(), wait them leave
 	pthread_mutex_lock(&hdl->listLock);
-	if (hdl->type & LU_TYPE_BLOCK) {
-		hdl->leaveFlag = 1;
-		pthread_cond_signal(&hdl->listCond);
+	while (__atomic_load_n(&hdl->waiters, __ATOMIC_SEQ_CST) > 0) {
+		pthread_cond_wait(&hdl->listCond, &hdl->listLock);
 	}
 	pthread_mutex_unlock(&hdl->listLock);
+    release_all_entry(hdl);
 	
-	usleep(100000); // waiting thread(lu_pop) end
-	
-	// lock again to confirm all waiting thread(lu_pop) is end
-	pthread_mutex_lock(&hdl->listLock);
-	pthread_mutex_unlock(&hdl->listLock);
 	// destory mutex & cond
     pthread_mutex_destroy(&hdl->listLock);
 	pthread_cond_destroy(&hdl->listCond);
+	free(hdl->ring);
+	heap_release(hdl->heap);
+	if (hdl->keyIndex) {
+		idmap_destroy(hdl->keyIndex);
+		free(hdl->keyIndex);
+	}
     free(hdl);
 }
 
+/*
+    Close list, adding to closed list fails and lu_pop() doesn't wait anymore
+    Threads blocked in lu_pop() are waked up, they get the remaining entries
+    or NULL
+*/
+void lu_close(LUHandler* hdl)
+{
+	pthread_mutex_lock(&hdl->listLock);
+	__atomic_store_n(&hdl->leaveFlag, 1, __ATOMIC_SEQ_CST);
+	pthread_cond_broadcast(&hdl->listCond);
+	pthread_mutex_unlock(&hdl->listLock);
+	if (hdl->ring) {
+		ring_wake(hdl, INT_MAX);
+	}
+}
+
+/*
+    Return 1 for closed by lu_close(), else 0
+*/
+int lu_is_closed(LUHandler* hdl)
+{
+	return is_closed(hdl);
+}
+
+/*
+    Preallocate memory for count entries
+    Return 0 for success, -1 for fail
+*/
+int lu_reserve_entries(LUHandler* hdl, int count)
+{
+    int ret;
+
+    if (hdl->heap) {
+        pthread_mutex_lock(&hdl->listLock);
+        ret = heap_reserve(hdl->heap, count);
+        pthread_mutex_unlock(&hdl->listLock);
+    } else if (hdl->entryPool) {
+        ret = mempool_reserve(hdl->entryPool, count);
+    } else { // ring capacity is fixed, intrusive entries are owned by user
+        ret = 0;
+    }
+    if (ret != 0) {
+        LOGE("lu_reserve_entries: out of memory");
+        return -1;
+    }
+    return 0;
+}
+
 /*
     Return 1 for empty, else 0
 */
 int lu_is_empty(LUHandler* hdl)
 {
+    if (hdl->ring) {
+        return ring_is_empty(hdl->ring);
+    }
+    if (hdl->heap) {
+        return (__atomic_load_n(&hdl->heap->count, __ATOMIC_RELAXED) == 0)? 1: 0;
+    }
     return (hdl->head == NULL)? 1: 0;
 }
 
@@ -143,7 +1080,19 @@ int lu_is_empty(LUHandler* hdl)
 */
 int lu_add(LUHandler* hdl, void* entrydata)
 {
-    LUEntry *entry = (LUEntry*) calloc(1, sizeof(LUEntry));
+    LUEntry *entry;
+
+    if (hdl->ring) {
+        return ring_add(hdl, entrydata);
+    }
+    if (hdl->heap) {
+        return (heap_add(hdl, &entrydata, 1) == 1)? 0: -1;
+    }
+    if (hdl->type & LU_TYPE_INTRUSIVE) {
+        LOGE("lu_add: LU_TYPE_INTRUSIVE list, use lu_add_node");
+        return -1;
+    }
+    entry = (LUEntry*) mempool_alloc(hdl->entryPool);
     if (!entry) {
         LOGE("lu_add: entry == NULL");
         return -1;
@@ -153,23 +1102,113 @@ int lu_add(LUHandler* hdl, void* entrydata)
     entry->data = entrydata;
 
     // add to list
+    if (link_entry(hdl, entry, 0) != 0) {
+        mempool_free(hdl->entryPool, entry);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+    Add items to list->tail in one lock, and wake up consumers once
+    Return number of added items, less than n while ring is full, -1 for fail
+*/
+int lu_add_batch(LUHandler* hdl, void** items, int n)
+{
+    LUEntry *first = NULL;
+    LUEntry *last = NULL;
+    LUEntry *rest = NULL;
+    LUEntry *entry;
+    int i;
+
+    if (n <= 0) {
+        return 0;
+    }
+    if (hdl->ring) {
+        return ring_add_batch(hdl, items, n);
+    }
+    if (hdl->heap) {
+        return heap_add(hdl, items, n);
+    }
+    if (hdl->type & LU_TYPE_INTRUSIVE) {
+        LOGE("lu_add_batch: LU_TYPE_INTRUSIVE list, use lu_add_node");
+        return -1;
+    }
+
+    // build the chain without lock
+    for (i = 0; i < n; i++) {
+        entry = (LUEntry*) mempool_alloc(hdl->entryPool);
+        if (!entry) {
+            LOGE("lu_add_batch: entry == NULL");
+            while (first) {
+                entry = first;
+                first = first->next;
+                mempool_free(hdl->entryPool, entry);
+            }
+            return -1;
+        }
+        entry->data = items[i];
+        entry->prev = last;
+        if (last) {
+            last->next = entry;
+        } else {
+            first = entry;
+        }
+        last = entry;
+    }
+
+    // splice chain to tail
     pthread_mutex_lock(&hdl->listLock);
-    if (hdl->tail) {
-        hdl->tail->next = entry;
-		entry->prev = hdl->tail;
-		entry->next = NULL;
-		hdl->tail = entry;
-    } else { // no tail imply no head, so fill it
-		hdl->tail = entry;
-        hdl->head = entry;
-		entry->prev = NULL;
-		entry->next = NULL;
+    if (hdl->leaveFlag) {
+        pthread_mutex_unlock(&hdl->listLock);
+        while (first) {
+            entry = first;
+            first = first->next;
+            mempool_free(hdl->entryPool, entry);
+        }
+        return -1;
+    }
+    if (hdl->keyIndex) {
+        // keyed list stops at the first key already in list
+        for (i = 0, entry = first; entry && index_entry(hdl, entry) == 0; entry = entry->next) {
+            i++;
+        }
+        rest = entry;
+        if (rest) {
+            last = rest->prev;
+            if (last) {
+                last->next = NULL;
+            } else {
+                first = NULL;
+            }
+        }
+        n = i;
+    }
+    if (first) {
+        if (hdl->tail) {
+            hdl->tail->next = first;
+            first->prev = hdl->tail;
+        } else { // no tail imply no head
+            hdl->head = first;
+        }
+        hdl->tail = last;
+        if (hdl->type & LU_TYPE_BLOCK) {
+            if (n > 1) {
+                pthread_cond_broadcast(&hdl->listCond);
+            } else {
+                pthread_cond_signal(&hdl->listCond);
+            }
+        }
     }
-	if (hdl->type & LU_TYPE_BLOCK)
-		pthread_cond_signal(&hdl->listCond);
     pthread_mutex_unlock(&hdl->listLock);
 
-    return 0;
+    // free entries not added
+    while (rest) {
+        entry = rest;
+        rest = rest->next;
+        mempool_free(hdl->entryPool, entry);
+    }
+    return n;
 }
 
 /*
@@ -185,40 +1224,45 @@ int lu_iterator(LUHandler* hdl, LUIteratorFunc itfunc, void* itdata)
 {
     int ret = 0;
     LUEntry *entry = NULL;
-    LUEntry *entry2free = NULL;
+    LUEntry *prev, *next;
+    uint64_t key = 0;
 
-    if (!itfunc) {
+    if (!itfunc || hdl->ring) {
         return -1;
     }
+    if (hdl->heap) {
+        return heap_iterator(hdl, itfunc, itdata);
+    }
 
     pthread_mutex_lock(&hdl->listLock);
     entry = hdl->head;
     while (entry) {
+        if (hdl->keyIndex) {
+            key = hdl->keyFunc(entry->data); // itfunc may free entrydata while removing
+        }
+        // LUNode of LU_TYPE_INTRUSIVE list may be freed with entrydata too
+        prev = entry->prev;
+        next = entry->next;
         ret = itfunc(hdl, entry->data, itdata);
         if (ret == LU_IT_BREAK) {
             break;
         } else if (ret == LU_IT_REMOVE || ret == LU_IT_REMOVE_BREAK) {
+            if (hdl->keyIndex) {
+                idmap_remove(hdl->keyIndex, key);
+            }
             // remove entry
-			if (hdl->head != entry && hdl->tail != entry) {
-				entry->prev->next = entry->next;
-				entry->next->prev = entry->prev;
-			} else {
-				if (hdl->head == entry) { // first entry
-					hdl->head = entry->next;
-					if (hdl->head) {
-						hdl->head->prev = NULL;
-					}
-				}
-				if (hdl->tail == entry) { // tail entry
-					hdl->tail = entry->prev;
-					if (hdl->tail) {
-						hdl->tail->next = NULL;
-					}
-				}
+			if (prev) {
+				prev->next = next;
+			} else { // first entry
+				hdl->head = next;
 			}
-            entry2free = entry;
-            entry = entry->next;
-            free(entry2free);
+			if (next) {
+				next->prev = prev;
+			} else { // tail entry
+				hdl->tail = prev;
+			}
+            free_entry(hdl, entry);
+            entry = next;
             
             // break or not
             if (ret == LU_IT_REMOVE_BREAK) {
@@ -235,6 +1279,37 @@ int lu_iterator(LUHandler* hdl, LUIteratorFunc itfunc, void* itdata)
     return ret;
 }
 
+/*
+    Do function, itfunc, for each entry in a copy of list, listLock is only
+    held while copying, so itfunc doesn't block adding and popping threads
+
+    itfunc() returns LU_IT_CONTINUE or LU_IT_BREAK, entries can't be removed
+*/
+int lu_iterator_snapshot(LUHandler* hdl, LUIteratorFunc itfunc, void* itdata)
+{
+    void** items = NULL;
+    int count;
+    int ret = 0;
+    int i;
+
+    if (!itfunc || hdl->ring) {
+        return -1;
+    }
+    count = snapshot_entries(hdl, &items);
+    if (count < 0) {
+        LOGE("lu_iterator_snapshot: out of memory");
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        ret = itfunc(hdl, items[i], itdata);
+        if (ret == LU_IT_BREAK) {
+            break;
+        }
+    }
+    free(items);
+    return ret;
+}
+
 /*
     dump all entries in list
 */
@@ -247,7 +1322,7 @@ int lu_dump_list(char* title, LUHandler* hdl, LUDumpFunc dumpFunc)
 
     dumpst.dumpFunc = dumpFunc;
     dumpst.count = 0;
-    iterator_entry(hdl, dump_entry, &dumpst);
+    lu_iterator_snapshot(hdl, dump_entry, &dumpst);
     
     if (title) LOGI("------ %s LIST END ------", title);
     else LOGI("------ DUMP LIST END ------");
@@ -267,9 +1342,12 @@ void* lu_find(LUHandler* hdl, LUMatchFunc matchFunc, void* matchdata)
     int ret = 0;
     LUEntry *entry;
 
-    if (!matchFunc) {
+    if (!matchFunc || hdl->ring) {
         return NULL;
     }
+    if (hdl->heap) {
+        return heap_match(hdl, matchFunc, matchdata, 0);
+    }
     
     pthread_mutex_lock(&hdl->listLock);
     entry = hdl->head;
@@ -297,34 +1375,22 @@ void* lu_remove(LUHandler* hdl, LUMatchFunc matchFunc, void* matchdata)
     LUEntry *entry;
     void *retdata = NULL;
 
-    if (!matchFunc) {
+    if (!matchFunc || hdl->ring) {
         return NULL;
     }
+    if (hdl->heap) {
+        return heap_match(hdl, matchFunc, matchdata, 1);
+    }
     
     pthread_mutex_lock(&hdl->listLock);
     entry = hdl->head;
     while (entry) {
         ret = matchFunc(entry->data, matchdata);
         if (ret == LU_IT_MATCH) {
-			if (hdl->head != entry && hdl->tail != entry) {
-				entry->prev->next = entry->next;
-				entry->next->prev = entry->prev;
-			} else {
-				if (hdl->head == entry) { // first entry
-					hdl->head = entry->next;
-					if (hdl->head) {
-						hdl->head->prev = NULL;
-					}
-				}
-				if (hdl->tail == entry) { // tail entry
-					hdl->tail = entry->prev;
-					if (hdl->tail) {
-						hdl->tail->next = NULL;
-					}
-				}
-			}
+            unlink_entry(hdl, entry);
+            unindex_entry(hdl, entry);
             retdata = entry->data;
-            free(entry); // free entry item
+            free_entry(hdl, entry); // free entry item
             break;
         }
         entry = entry->next;
@@ -333,12 +1399,77 @@ void* lu_remove(LUHandler* hdl, LUMatchFunc matchFunc, void* matchdata)
     return retdata;
 }
 
+/*
+    Keyed list only
+    Return the entrydata of key, NULL while not found
+*/
+void* lu_find_key(LUHandler* hdl, uint64_t key)
+{
+    LUEntry *entry;
+    void *retdata = NULL;
+
+    if (!hdl->keyIndex) {
+        LOGE("lu_find_key: not keyed list");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&hdl->listLock);
+    entry = (LUEntry*) idmap_get(hdl->keyIndex, key);
+    if (entry) {
+        retdata = entry->data;
+    }
+    pthread_mutex_unlock(&hdl->listLock);
+    return retdata;
+}
+
+/*
+    Keyed list only
+    if found, return the entrydata of key and remove the entry
+    return NULL while not found
+*/
+void* lu_remove_key(LUHandler* hdl, uint64_t key)
+{
+    LUEntry *entry;
+    void *retdata = NULL;
+
+    if (!hdl->keyIndex) {
+        LOGE("lu_remove_key: not keyed list");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&hdl->listLock);
+    entry = (LUEntry*) idmap_remove(hdl->keyIndex, key);
+    if (entry) {
+        unlink_entry(hdl, entry);
+        retdata = entry->data;
+    }
+    pthread_mutex_unlock(&hdl->listLock);
+
+    if (entry) {
+        free_entry(hdl, entry);
+    }
+    return retdata;
+}
+
 /*
    push data to list->head for FILO
 */
 int lu_push(LUHandler* hdl, void* entrydata)
 {
-    LUEntry *entry = (LUEntry*) calloc(1, sizeof(LUEntry));
+    LUEntry *entry;
+
+    if (hdl->ring) {
+        LOGE("lu_push: ring is FIFO only, use lu_enqueue");
+        return -1;
+    }
+    if (hdl->heap) {
+        return lu_add(hdl, entrydata);
+    }
+    if (hdl->type & LU_TYPE_INTRUSIVE) {
+        LOGE("lu_push: LU_TYPE_INTRUSIVE list, use lu_push_node");
+        return -1;
+    }
+    entry = (LUEntry*) mempool_alloc(hdl->entryPool);
     if (!entry) {
         LOGE("lu_push: entry == NULL");
         return -1;
@@ -348,46 +1479,39 @@ int lu_push(LUHandler* hdl, void* entrydata)
     entry->data = entrydata;
 
     // add to list
-    pthread_mutex_lock(&hdl->listLock);
-    if (hdl->head) {
-		hdl->head->prev = entry;
-		entry->next = hdl->head;
-		hdl->head = entry;
-		entry->prev = NULL;
-    } else { // no head imply no tail, so fill it
-		hdl->head = entry;
-		hdl->tail = entry;
-		entry->prev = NULL;
-		entry->next = NULL;
+    if (link_entry(hdl, entry, 1) != 0) {
+        mempool_free(hdl->entryPool, entry);
+        return -1;
     }
-	if (hdl->type & LU_TYPE_BLOCK)
-		pthread_cond_signal(&hdl->listCond);
-    pthread_mutex_unlock(&hdl->listLock);
-
     return 0;
 }
 
-void* lu_pop(LUHandler* hdl)
+/*
+    detach list->head, LU_TYPE_BLOCK_xxx waits once while list is empty
+    waited:
+        output, 1 if waiters is raised, caller decreases it after using hdl
+*/
+static LUEntry* pop_entry(LUHandler* hdl, int* waited)
 {
     LUEntry *entry = NULL;
-    void *retdata = NULL;
 
-	// add to list
     pthread_mutex_lock(&hdl->listLock);
 	do {
 		if (hdl->head == NULL) {
-			if (hdl->type & LU_TYPE_BLOCK) { // wait for push or queue
+			if ((hdl->type & LU_TYPE_BLOCK) && hdl->leaveFlag == 0) { // wait for push or queue
+				*waited = 1;
+				__atomic_add_fetch(&hdl->waiters, 1, __ATOMIC_SEQ_CST);
 				pthread_cond_wait(&hdl->listCond, &hdl->listLock);
 			} else { // return immediately
 				break;
 			}
 		}
-		if (hdl->leaveFlag == 1 || hdl->head == NULL) {
+		if (hdl->head == NULL) {
 			break;
 		}
 
 		entry = hdl->head;
-		retdata = entry->data;
+		unindex_entry(hdl, entry);
 		// modify head
 		hdl->head = hdl->head->next;
 		if (hdl->head) {
@@ -403,30 +1527,258 @@ void* lu_pop(LUHandler* hdl)
 	}
 	while (0);
 	pthread_mutex_unlock(&hdl->listLock);
+	return entry;
+}
+
+void* lu_pop(LUHandler* hdl)
+{
+    LUEntry *entry = NULL;
+    void *retdata = NULL;
+	int waited = 0;
+
+	if (hdl->ring) {
+		return ring_pop(hdl);
+	}
+	if (hdl->heap) {
+		heap_pop_batch(hdl, &retdata, 1, -1);
+		return retdata;
+	}
+
+	entry = pop_entry(hdl, &waited);
+	if (entry) {
+		retdata = entry->data;
+		free_entry(hdl, entry);
+	}
+	if (waited) {
+		leave_wait(hdl); // hdl may be released after this
+	}
+    return retdata;
+}
+
+/*
+    LU_TYPE_INTRUSIVE only, add node to list->tail without allocation
+*/
+int lu_add_node(LUHandler* hdl, LUNode* node, void* entrydata)
+{
+    if (!(hdl->type & LU_TYPE_INTRUSIVE)) {
+        LOGE("lu_add_node: not LU_TYPE_INTRUSIVE list");
+        return -1;
+    }
+    node->data = entrydata;
+    return link_entry(hdl, node, 0);
+}
+
+/*
+    LU_TYPE_INTRUSIVE only, add node to list->head without allocation
+*/
+int lu_push_node(LUHandler* hdl, LUNode* node, void* entrydata)
+{
+    if (!(hdl->type & LU_TYPE_INTRUSIVE)) {
+        LOGE("lu_push_node: not LU_TYPE_INTRUSIVE list");
+        return -1;
+    }
+    node->data = entrydata;
+    return link_entry(hdl, node, 1);
+}
+
+/*
+    LU_TYPE_INTRUSIVE only, pop node from list->head
+*/
+LUNode* lu_pop_node(LUHandler* hdl)
+{
+    LUEntry *entry;
+	int waited = 0;
+
+    if (!(hdl->type & LU_TYPE_INTRUSIVE)) {
+        LOGE("lu_pop_node: not LU_TYPE_INTRUSIVE list");
+        return NULL;
+    }
+	entry = pop_entry(hdl, &waited);
+	if (waited) {
+		leave_wait(hdl); // hdl may be released after this
+	}
+    return entry;
+}
+
+/*
+    LU_TYPE_INTRUSIVE only, unlink node in O(1)
+*/
+void lu_remove_node(LUHandler* hdl, LUNode* node)
+{
+    if (!(hdl->type & LU_TYPE_INTRUSIVE)) {
+        LOGE("lu_remove_node: not LU_TYPE_INTRUSIVE list");
+        return;
+    }
+    pthread_mutex_lock(&hdl->listLock);
+    unindex_entry(hdl, node);
+    unlink_entry(hdl, node);
+    pthread_mutex_unlock(&hdl->listLock);
+}
+
+/*
+    Pop data from list->tail without waiting
+    Return NULL while list is empty
+*/
+void* lu_pop_tail(LUHandler* hdl)
+{
+    LUEntry *entry = NULL;
+    void *retdata = NULL;
+
+	if (hdl->ring) {
+		LOGE("lu_pop_tail: ring is FIFO only, use lu_dequeue");
+		return NULL;
+	}
+	if (hdl->heap) {
+		LOGE("lu_pop_tail: priority list has no tail, use lu_pop");
+		return NULL;
+	}
+
+    pthread_mutex_lock(&hdl->listLock);
+	entry = hdl->tail;
+	if (entry) {
+		retdata = entry->data;
+		unindex_entry(hdl, entry);
+		hdl->tail = entry->prev;
+		if (hdl->tail) {
+			hdl->tail->next = NULL;
+		} else { // no tail imply no head
+			hdl->head = NULL;
+		}
+	}
+	pthread_mutex_unlock(&hdl->listLock);
 
 	if (entry) {
-		free(entry);
+		free_entry(hdl, entry);
 	}
     return retdata;
 }
 
+/*
+    Pop data from list->head, LU_TYPE_BLOCK_xxx waits at most timeout
+    timeout:
+        usec. 0 for no wait, -1 for wait forever
+    Return NULL for timeout, lu_notify() or closed list is empty
+*/
+void* lu_pop_timed(LUHandler* hdl, int64_t timeout)
+{
+    void* data = NULL;
+
+    lu_pop_batch(hdl, &data, 1, timeout);
+    return data;
+}
+
+/*
+    Pop at most max entries from list->head in one lock
+    timeout:
+        usec. LU_TYPE_BLOCK_xxx waits once until list is not empty, notified or closed
+        (ring lists ignore lu_notify())
+        0 for no wait, -1 for wait forever
+    Return number of entries in out, 0 for timeout, lu_notify() or closed list is empty
+*/
+int lu_pop_batch(LUHandler* hdl, void** out, int max, int64_t timeout)
+{
+    LUEntry *chain = NULL;
+    LUEntry *last = NULL;
+    LUEntry *entry;
+    struct timespec ts;
+    int count = 0;
+    int waited = 0;
+
+    if (max <= 0) {
+        return 0;
+    }
+    if (hdl->ring) {
+        return ring_pop_batch(hdl, out, max, timeout);
+    }
+    if (hdl->heap) {
+        return heap_pop_batch(hdl, out, max, timeout);
+    }
+    if (timeout > 0) {
+        us_to_timespec(get_clock_us() + timeout, &ts);
+    }
+
+    pthread_mutex_lock(&hdl->listLock);
+    if (hdl->type & LU_TYPE_BLOCK) {
+        // wait once like pop_entry(), lu_notify() wakes it up too
+        if (hdl->head == NULL && timeout != 0 && hdl->leaveFlag == 0) {
+            waited = 1;
+            __atomic_add_fetch(&hdl->waiters, 1, __ATOMIC_SEQ_CST);
+            if (timeout < 0) {
+                pthread_cond_wait(&hdl->listCond, &hdl->listLock);
+            } else {
+                pthread_cond_timedwait(&hdl->listCond, &hdl->listLock, &ts);
+            }
+        }
+    }
+    if (hdl->head) {
+        // detach the first max entries
+        chain = hdl->head;
+        for (entry = chain; entry && count < max; entry = entry->next) {
+            unindex_entry(hdl, entry);
+            last = entry;
+            count++;
+        }
+        hdl->head = entry;
+        if (entry) {
+            entry->prev = NULL;
+        } else {
+            hdl->tail = NULL;
+        }
+        last->next = NULL;
+    }
+    pthread_mutex_unlock(&hdl->listLock);
+
+    // free entries without lock
+    count = 0;
+    while (chain) {
+        entry = chain;
+        chain = chain->next;
+        out[count++] = entry->data;
+        free_entry(hdl, entry);
+    }
+    if (waited) {
+        leave_wait(hdl); // hdl may be released after this
+    }
+    return count;
+}
+
 void lu_clear(LUHandler* hdl)
 {
 	LUEntry *entry = NULL;
 	LUEntry *entry2free = NULL;
+	void* data;
 	
+	if (hdl->ring) {
+		while (ring_dequeue(hdl->ring, &data) == 0);
+		return;
+	}
+	if (hdl->heap) {
+		pthread_mutex_lock(&hdl->listLock);
+		hdl->heap->count = 0;
+		pthread_mutex_unlock(&hdl->listLock);
+		return;
+	}
 	pthread_mutex_lock(&hdl->listLock);
 	entry = hdl->head;
 	while (entry) {
 		entry2free = entry;
 		entry = entry->next;
-		free(entry2free);
+		free_entry(hdl, entry2free);
+	}
+	hdl->head = NULL;
+	hdl->tail = NULL;
+	if (hdl->keyIndex) {
+		idmap_clear(hdl->keyIndex);
 	}
 	pthread_mutex_unlock(&hdl->listLock);
 }
 
 void lu_notify(LUHandler* hdl)
 {
+	if (hdl->ring) {
+		ring_wake(hdl, 1);
+		return;
+	}
 	pthread_mutex_lock(&hdl->listLock);
 	pthread_cond_signal(&hdl->listCond);
 	pthread_mutex_unlock(&hdl->listLock);
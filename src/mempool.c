@@ -0,0 +1,373 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mempool.h"
+
+#define MEMPOOL_ALIGN			8
+#define MEMPOOL_CHUNK_HEADER	16 // chunk link, keep items aligned
+#define MEMPOOL_MIN_CHUNK		64 // items of first chunk, doubled for each new chunk
+#define MEMPOOL_MAX_CHUNK		4096
+#define MEMPOOL_CACHE_POOLS		4 // pools cached by one thread
+#define MEMPOOL_SHARED_POOLS	8 // item sizes of mempool_shared()
+#define MEMPOOL_CACHE_SIZE		64 // max free items cached by one thread for one pool
+#define MEMPOOL_BATCH			(MEMPOOL_CACHE_SIZE / 2) // items moved from/to shared list at once
+
+// free item and chunk are linked by their first pointer
+#define ITEM_NEXT(item)			(*(void**) (item))
+
+/*
+	pool state shared with thread caches
+	each cache entry bound to the pool holds a reference, so the core stays
+	valid for eviction after mempool_destroy() and no global lookup is needed
+*/
+typedef struct MemPoolCoreST {
+	pthread_mutex_t lock;
+	int refs; // pool and bound cache entries, atomic
+	int destroyed; // chunks were freed by mempool_destroy(), protected by lock
+	int itemSize;
+	int chunkItems; // item count of next chunk
+	int totalCount; // item count of all chunks
+	void* freeList; // shared free items
+	int freeCount;
+	void* chunks; // all chunks, freed by mempool_destroy()
+} MemPoolCore;
+
+typedef struct {
+	MemPoolCore* core; // NULL for unused entry
+	void* head;
+	int count;
+	uint64_t lastUse;
+} MemCacheEntry;
+
+typedef struct {
+	MemCacheEntry entries[MEMPOOL_CACHE_POOLS];
+	uint64_t useCount;
+} MemCache;
+
+static pthread_mutex_t sharedLock = PTHREAD_MUTEX_INITIALIZER;
+static MemPool sharedPools[MEMPOOL_SHARED_POOLS];
+static int sharedCount;
+
+static pthread_once_t cacheKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t cacheKey;
+static int cacheKeyValid;
+
+////////////////////////////////////////////////////////////////////////////////
+// Memory Pool Utility
+////////////////////////////////////////////////////////////////////////////////
+/*
+	caller must hold core->lock
+*/
+static int pool_grow(MemPoolCore* core, int count)
+{
+	char* chunk;
+	char* item;
+	int i;
+
+	chunk = (char*) malloc(MEMPOOL_CHUNK_HEADER + (size_t) count * core->itemSize);
+	if (!chunk) {
+		return -1;
+	}
+	ITEM_NEXT(chunk) = core->chunks;
+	core->chunks = chunk;
+	// link from the last item, so free list is in address order
+	item = chunk + MEMPOOL_CHUNK_HEADER + (size_t) (count - 1) * core->itemSize;
+	for (i = 0; i < count; i++, item -= core->itemSize) {
+		ITEM_NEXT(item) = core->freeList;
+		core->freeList = item;
+	}
+	core->freeCount += count;
+	core->totalCount += count;
+	return 0;
+}
+
+/*
+	move at most count items from shared list to *head
+	return the number of moved items, 0 for out of memory
+*/
+static int pool_take(MemPoolCore* core, void** head, int count)
+{
+	void* item;
+	int i;
+
+	pthread_mutex_lock(&core->lock);
+	if (!core->freeList) {
+		if (pool_grow(core, core->chunkItems) != 0) {
+			pthread_mutex_unlock(&core->lock);
+			return 0;
+		}
+		if (core->chunkItems < MEMPOOL_MAX_CHUNK) {
+			core->chunkItems *= 2;
+		}
+	}
+	for (i = 0; i < count && core->freeList; i++) {
+		item = core->freeList;
+		core->freeList = ITEM_NEXT(item);
+		ITEM_NEXT(item) = *head;
+		*head = item;
+	}
+	core->freeCount -= i;
+	pthread_mutex_unlock(&core->lock);
+	return i;
+}
+
+/*
+	move count items from *head to shared list
+*/
+static void pool_put(MemPoolCore* core, void** head, int count)
+{
+	void* item;
+	int i;
+
+	pthread_mutex_lock(&core->lock);
+	if (core->destroyed) { // items were freed with chunks
+		pthread_mutex_unlock(&core->lock);
+		return;
+	}
+	for (i = 0; i < count && *head; i++) {
+		item = *head;
+		*head = ITEM_NEXT(item);
+		ITEM_NEXT(item) = core->freeList;
+		core->freeList = item;
+	}
+	core->freeCount += i;
+	pthread_mutex_unlock(&core->lock);
+}
+
+static void core_release(MemPoolCore* core)
+{
+	if (__atomic_sub_fetch(&core->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		pthread_mutex_destroy(&core->lock);
+		free(core);
+	}
+}
+
+/*
+	give cached items back to their pool and drop the reference
+	if the pool was destroyed, its chunks were freed, so just drop them
+*/
+static void cache_flush(MemCacheEntry* entry)
+{
+	if (entry->core) {
+		if (entry->head) {
+			pool_put(entry->core, &entry->head, entry->count);
+		}
+		core_release(entry->core);
+	}
+	memset(entry, 0, sizeof(MemCacheEntry));
+}
+
+/*
+	thread exit, give all cached items back
+*/
+static void cache_release(void* param)
+{
+	MemCache* cache = (MemCache*) param;
+	int i;
+
+	for (i = 0; i < MEMPOOL_CACHE_POOLS; i++) {
+		cache_flush(&cache->entries[i]);
+	}
+	free(cache);
+}
+
+static void cache_key_create(void)
+{
+	cacheKeyValid = (pthread_key_create(&cacheKey, cache_release) == 0);
+}
+
+/*
+	return cache entry of pool for current thread, evict the least recently
+	used entry while all entries are used
+	return NULL while thread cache is not available
+*/
+static MemCacheEntry* get_cache_entry(MemPool* pool)
+{
+	MemCache* cache;
+	MemCacheEntry* entry = NULL;
+	int i;
+
+	pthread_once(&cacheKeyOnce, cache_key_create);
+	if (!cacheKeyValid) {
+		return NULL;
+	}
+	cache = (MemCache*) pthread_getspecific(cacheKey);
+	if (!cache) {
+		cache = (MemCache*) calloc(1, sizeof(MemCache));
+		if (!cache) {
+			return NULL;
+		}
+		if (pthread_setspecific(cacheKey, cache) != 0) {
+			free(cache);
+			return NULL;
+		}
+	}
+
+	cache->useCount++;
+	for (i = 0; i < MEMPOOL_CACHE_POOLS; i++) {
+		if (cache->entries[i].core == pool->core) {
+			entry = &cache->entries[i];
+			entry->lastUse = cache->useCount;
+			return entry;
+		}
+		// unused entry has lastUse 0, so it is picked first
+		if (!entry || cache->entries[i].lastUse < entry->lastUse) {
+			entry = &cache->entries[i];
+		}
+	}
+	cache_flush(entry);
+	__atomic_add_fetch(&pool->core->refs, 1, __ATOMIC_RELAXED);
+	entry->core = pool->core;
+	entry->lastUse = cache->useCount;
+	return entry;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Memory Pool Export Function
+////////////////////////////////////////////////////////////////////////////////
+static int item_size(int itemSize)
+{
+	if (itemSize < (int) sizeof(void*)) {
+		itemSize = (int) sizeof(void*);
+	}
+	return (itemSize + MEMPOOL_ALIGN - 1) & ~(MEMPOOL_ALIGN - 1);
+}
+
+int mempool_init(MemPool* pool, int itemSize)
+{
+	MemPoolCore* core;
+
+	memset(pool, 0, sizeof(MemPool));
+	core = (MemPoolCore*) calloc(1, sizeof(MemPoolCore));
+	if (!core) {
+		return -1;
+	}
+	core->itemSize = item_size(itemSize);
+	core->chunkItems = MEMPOOL_MIN_CHUNK;
+	core->refs = 1;
+	if (pthread_mutex_init(&core->lock, NULL) != 0) {
+		free(core);
+		return -1;
+	}
+	pool->core = core;
+	return 0;
+}
+
+void mempool_destroy(MemPool* pool)
+{
+	MemPoolCore* core = pool->core;
+	MemCache* cache;
+	void* chunk;
+	int i;
+
+	if (!core) {
+		return;
+	}
+	// items cached by current thread are freed with chunks
+	// items cached by other threads are dropped when they are flushed
+	cache = cacheKeyValid? (MemCache*) pthread_getspecific(cacheKey): NULL;
+	if (cache) {
+		for (i = 0; i < MEMPOOL_CACHE_POOLS; i++) {
+			if (cache->entries[i].core == core) {
+				core_release(core);
+				memset(&cache->entries[i], 0, sizeof(MemCacheEntry));
+			}
+		}
+	}
+
+	pthread_mutex_lock(&core->lock);
+	core->destroyed = 1;
+	while (core->chunks) {
+		chunk = core->chunks;
+		core->chunks = ITEM_NEXT(chunk);
+		free(chunk);
+	}
+	core->freeList = NULL;
+	core->freeCount = 0;
+	core->totalCount = 0;
+	pthread_mutex_unlock(&core->lock);
+	core_release(core);
+	memset(pool, 0, sizeof(MemPool));
+}
+
+MemPool* mempool_shared(int itemSize)
+{
+	MemPool* pool = NULL;
+	int i;
+
+	itemSize = item_size(itemSize);
+	pthread_mutex_lock(&sharedLock);
+	for (i = 0; i < sharedCount; i++) {
+		if (sharedPools[i].core->itemSize == itemSize) {
+			pool = &sharedPools[i];
+			break;
+		}
+	}
+	if (!pool && sharedCount < MEMPOOL_SHARED_POOLS &&
+			mempool_init(&sharedPools[sharedCount], itemSize) == 0) {
+		pool = &sharedPools[sharedCount++];
+	}
+	pthread_mutex_unlock(&sharedLock);
+	return pool;
+}
+
+int mempool_reserve(MemPool* pool, int count)
+{
+	int ret = 0;
+
+	if (count <= 0) {
+		return 0;
+	}
+	pthread_mutex_lock(&pool->core->lock);
+	ret = pool_grow(pool->core, count);
+	pthread_mutex_unlock(&pool->core->lock);
+	return ret;
+}
+
+void* mempool_alloc(MemPool* pool)
+{
+	MemCacheEntry* entry = get_cache_entry(pool);
+	void* item = NULL;
+
+	if (!entry) { // no thread cache, take one item from shared list
+		if (pool_take(pool->core, &item, 1) == 0) {
+			return NULL;
+		}
+	} else {
+		if (!entry->head) {
+			entry->count += pool_take(pool->core, &entry->head, MEMPOOL_BATCH);
+			if (!entry->head) {
+				return NULL;
+			}
+		}
+		item = entry->head;
+		entry->head = ITEM_NEXT(item);
+		entry->count--;
+	}
+	memset(item, 0, pool->core->itemSize);
+	return item;
+}
+
+void mempool_free(MemPool* pool, void* item)
+{
+	MemCacheEntry* entry;
+
+	if (!item) {
+		return;
+	}
+	entry = get_cache_entry(pool);
+	if (!entry) { // no thread cache, put back to shared list
+		ITEM_NEXT(item) = NULL;
+		pool_put(pool->core, &item, 1);
+		return;
+	}
+	ITEM_NEXT(item) = entry->head;
+	entry->head = item;
+	entry->count++;
+	if (entry->count > MEMPOOL_CACHE_SIZE) {
+		// give a batch back, so the thread allocating them can reuse
+		pool_put(pool->core, &entry->head, MEMPOOL_BATCH);
+		entry->count -= MEMPOOL_BATCH;
+	}
+}
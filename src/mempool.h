@@ -0,0 +1,61 @@
+#ifndef __MEM_POOL_H__
+#define __MEM_POOL_H__
+
+#include <pthread.h>
+
+/*
+	Internal fixed size item allocator for TLTask and LUEntry.
+	Items are carved from chunks and never returned to the system before
+	mempool_destroy(), so add/remove in steady state does not call malloc.
+	Each thread keeps a small cache of free items per pool, and moves
+	items from/to the shared free list in batch under the pool lock.
+	Cache entries hold a reference to the pool core, so a thread evicting
+	or flushing its cache only takes the lock of that pool.
+	Lists and handlers use mempool_shared(), one pool per item size, so a
+	thread touching many lists still hits its cache.
+	Thread safe.
+*/
+struct MemPoolCoreST;
+
+typedef struct MemPoolST {
+	struct MemPoolCoreST* core; // freed by the last reference, pool or thread cache
+} MemPool;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+	return 0 for success, -1 for fail
+*/
+int mempool_init(MemPool* pool, int itemSize);
+
+/*
+	free all chunks, items still in use become invalid
+*/
+void mempool_destroy(MemPool* pool);
+
+/*
+	return the process wide pool of itemSize, created at first call and
+	never destroyed, items must be freed one by one
+	return NULL for out of memory
+*/
+MemPool* mempool_shared(int itemSize);
+
+/*
+	preallocate count more free items
+	return 0 for success, -1 for out of memory
+*/
+int mempool_reserve(MemPool* pool, int count);
+
+/*
+	return zero filled item, NULL for out of memory
+*/
+void* mempool_alloc(MemPool* pool);
+void mempool_free(MemPool* pool, void* item);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,3 +1,10 @@
+#ifdef __linux__
+#define _GNU_SOURCE // pthread_setaffinity_np, sched_getcpu
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,9 +22,31 @@
 #include "log.h"
 
 #include "tasklist.h"
+#include "listutil.h"
+#include "executor.h"
+#include "idmap.h"
+#include "mempool.h"
 
 typedef int (*TLIteratorTaskFunc)(TLTask* task, void* itdata);
 
+/*
+	copy of a queued task, iterated without listLock
+*/
+typedef struct {
+	TLTask* task; // address for dump only, task may be freed after copy
+	TLTaskFunc taskFunc;
+	void* taskdata;
+	int64_t abstime; // usec of monotonic clock
+} TLTaskSnapshot;
+
+typedef int (*TLIteratorSnapshotFunc)(TaskListHandler* hdl, TLTaskSnapshot* snap, void* itdata);
+
+struct TASK_SNAPSHOT_ST {
+	TLTaskSnapshot* snaps;
+	int count;
+	int capacity;
+};
+
 #define MAX_DUMP_STR_BUF_LEN	1024
 struct TASK_DUMP_ST {
 	char strBuf[MAX_DUMP_STR_BUF_LEN];
@@ -25,329 +54,2349 @@ struct TASK_DUMP_ST {
 	TLDumpFunc dumpFunc;
 };
 
+struct TASK_ITERATOR_ST {
+	TaskListHandler* hdl;
+	TLIteratorFunc itfunc;
+	void* itdata;
+	int ret;
+	TLTask** removeTasks;
+	int removeCount;
+	int removeCapacity;
+};
+
+struct TASK_USER_SNAPSHOT_ST {
+	TLIteratorFunc itfunc;
+	void* itdata;
+};
+
+struct TASK_MATCH_ST {
+	TLMatchFunc matchFunc;
+	void* matchdata;
+	TLTask* found;
+};
+
+#ifdef _MSC_VER
+#define TL_THREAD_LOCAL	__declspec(thread)
+#else
+#define TL_THREAD_LOCAL	__thread
+#endif
+
+static TL_THREAD_LOCAL int64_t taskOverrun; // for tl_get_task_overrun() in callback
+static TL_THREAD_LOCAL TLTask* currentTask; // task whose callback is running in this thread
+
+static void inbox_push(TaskListHandler* hdl, TLTask* first, TLTask* last);
+static void wakeup_loop(TaskListHandler* hdl, int64_t abstime);
+static void untrack_task(TaskListHandler* hdl, TLTask* task);
+
 ////////////////////////////////////////////////////////////////////////////////
 // Utility function
 ////////////////////////////////////////////////////////////////////////////////
-static int64_t get_current_ms_time(void)
+#ifdef CLOCK_MONOTONIC
+#define TL_CLOCK	CLOCK_MONOTONIC // not affected by NTP step or date change
+#else
+#define TL_CLOCK	CLOCK_REALTIME
+#endif
+
+/*
+	usec of TL_CLOCK, all tasks and loop use this time
+	clock_gettime() is a vDSO call without syscall on linux
+*/
+static int64_t get_current_us_time(void)
+{
+	struct timespec ts;
+	clock_gettime(TL_CLOCK, &ts);
+
+	return ((int64_t) ts.tv_sec * 1000000) + ((int64_t) ts.tv_nsec / 1000);
+}
+
+/*
+	usec from 1970
+*/
+static int64_t get_wall_us_time(void)
 {
 	struct timeval tv;
 	gettimeofday(&tv, NULL);
 	
-	return ((int64_t) tv.tv_sec * 1000) + ((int64_t) tv.tv_usec / 1000);
+	return ((int64_t) tv.tv_sec * 1000000) + ((int64_t) tv.tv_usec);
+}
+
+/*
+	convert msec from 1970 to usec of TL_CLOCK
+*/
+static int64_t abstime_to_clock_time(int64_t abstime)
+{
+	return abstime * 1000 - (get_wall_us_time() - get_current_us_time());
+}
+
+/*
+	convert usec of TL_CLOCK to msec from 1970
+*/
+static int64_t clock_time_to_abstime(int64_t clockTime)
+{
+	return (clockTime + (get_wall_us_time() - get_current_us_time())) / 1000;
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// Task List Utility
+// Task Heap Utility
 ////////////////////////////////////////////////////////////////////////////////
+#define TL_HEAP_INIT_CAPACITY	64
+
+#define HEAP_PARENT(i)	(((i) - 1) / 2)
+#define HEAP_LEFT(i)	(2 * (i) + 1)
+
+static void heap_set(TaskListHandler* hdl, int idx, TLTask* task)
+{
+	hdl->heap[idx] = task;
+	task->queueIndex = idx;
+}
+
+static void heap_sift_up(TaskListHandler* hdl, int idx)
+{
+	TLTask* task = hdl->heap[idx];
+
+	while (idx > 0) {
+		int parent = HEAP_PARENT(idx);
+		if (hdl->heap[parent]->abstime <= task->abstime) {
+			break;
+		}
+		heap_set(hdl, idx, hdl->heap[parent]);
+		idx = parent;
+	}
+	heap_set(hdl, idx, task);
+}
+
+static void heap_sift_down(TaskListHandler* hdl, int idx)
+{
+	TLTask* task = hdl->heap[idx];
+	int child;
+
+	while ((child = HEAP_LEFT(idx)) < hdl->heapSize) {
+		if (child + 1 < hdl->heapSize &&
+			hdl->heap[child + 1]->abstime < hdl->heap[child]->abstime) {
+			child++;
+		}
+		if (task->abstime <= hdl->heap[child]->abstime) {
+			break;
+		}
+		heap_set(hdl, idx, hdl->heap[child]);
+		idx = child;
+	}
+	heap_set(hdl, idx, task);
+}
+
 /*
-	find and upate minTask
+	make sure heap can hold count tasks
+	return 0 for success, -1 for out of memory
 */
-static void update_min_task(TaskListHandler* hdl)
+static int heap_reserve(TaskListHandler* hdl, int count)
 {
-	int64_t current = get_current_ms_time();
-	int64_t abstime = 3600000 + current; // 3600000 ms, 1 hours.
-	TLTask* task = hdl->tasklist;
+	TLTask** heap;
+	int capacity = hdl->heapCapacity ? hdl->heapCapacity : TL_HEAP_INIT_CAPACITY;
 
-	hdl->minTask = hdl->tasklist;
-	while (task) {
-		if (abstime > task->abstime) {
-			abstime = task->abstime;
-			hdl->minTask = task;
+	if (count <= hdl->heapCapacity) {
+		return 0;
+	}
+	while (capacity < count) {
+		capacity *= 2;
+	}
+	heap = (TLTask**) realloc(hdl->heap, capacity * sizeof(TLTask*));
+	if (!heap) {
+		return -1;
+	}
+	hdl->heap = heap;
+	hdl->heapCapacity = capacity;
+	return 0;
+}
+
+/*
+	caller must reserve space by heap_reserve() first
+*/
+static void heap_push(TaskListHandler* hdl, TLTask* task)
+{
+	hdl->heap[hdl->heapSize] = task;
+	task->queueIndex = hdl->heapSize;
+	hdl->heapSize++;
+	heap_sift_up(hdl, task->queueIndex);
+}
+
+static void heap_remove(TaskListHandler* hdl, TLTask* task)
+{
+	int idx = task->queueIndex;
+	TLTask* last;
+
+	hdl->heapSize--;
+	last = hdl->heap[hdl->heapSize];
+	hdl->heap[hdl->heapSize] = NULL;
+	task->queueIndex = -1;
+	if (last == task) {
+		return;
+	}
+	heap_set(hdl, idx, last);
+	if (idx > 0 && hdl->heap[HEAP_PARENT(idx)]->abstime > last->abstime) {
+		heap_sift_up(hdl, idx);
+	} else {
+		heap_sift_down(hdl, idx);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Timing Wheel Utility
+////////////////////////////////////////////////////////////////////////////////
+/*
+	Hierarchical timing wheel, one tick is 1 msec of TL_CLOCK.
+	root level has 256 slots, each upper level has 64 slots and a slot of
+	level N covers a whole round of level N-1. When root level wraps, the
+	current slot of upper level is cascaded down into lower levels.
+	5 levels cover 2^32 msec (about 49 days), later tasks stay in the top
+	level and are re-cascaded until they are close enough.
+*/
+#define TL_WHEEL_ROOT_BITS		8
+#define TL_WHEEL_LEVEL_BITS		6
+#define TL_WHEEL_LEVELS			5
+#define TL_WHEEL_ROOT_SIZE		(1 << TL_WHEEL_ROOT_BITS)
+#define TL_WHEEL_LEVEL_SIZE		(1 << TL_WHEEL_LEVEL_BITS)
+#define TL_WHEEL_ROOT_MASK		(TL_WHEEL_ROOT_SIZE - 1)
+#define TL_WHEEL_LEVEL_MASK		(TL_WHEEL_LEVEL_SIZE - 1)
+#define TL_WHEEL_SLOTS			(TL_WHEEL_ROOT_SIZE + (TL_WHEEL_LEVELS - 1) * TL_WHEEL_LEVEL_SIZE)
+#define TL_WHEEL_EXPIRED_SLOT	TL_WHEEL_SLOTS // timeout tasks wait here for do_task()
+#define TL_WHEEL_MAX_DELTA		((INT64_C(1) << (TL_WHEEL_ROOT_BITS + (TL_WHEEL_LEVELS - 1) * TL_WHEEL_LEVEL_BITS)) - 1)
+
+#define WHEEL_LEVEL_SHIFT(level)	(TL_WHEEL_ROOT_BITS + ((level) - 1) * TL_WHEEL_LEVEL_BITS)
+#define WHEEL_LEVEL_OFFSET(level)	(TL_WHEEL_ROOT_SIZE + ((level) - 1) * TL_WHEEL_LEVEL_SIZE)
+#define WHEEL_TICK(us)				(((us) + 999) / 1000) // round up, never fire early
+
+struct TLWheelST {
+	int64_t current; // msec, next tick to be processed
+	int count; // tasks in all levels, not include expired slot
+	int rootCount; // tasks in root level
+	TLTask* slots[TL_WHEEL_SLOTS + 1]; // +1 for expired slot
+};
+
+static int wheel_slot_of(struct TLWheelST* wheel, int64_t tick)
+{
+	int64_t expires = tick;
+	int64_t delta;
+	int level;
+
+	if (expires < wheel->current) {
+		expires = wheel->current;
+	} else if (expires - wheel->current > TL_WHEEL_MAX_DELTA) {
+		expires = wheel->current + TL_WHEEL_MAX_DELTA;
+	}
+	delta = expires - wheel->current;
+	if (delta < TL_WHEEL_ROOT_SIZE) {
+		return (int) (expires & TL_WHEEL_ROOT_MASK);
+	}
+	for (level = 1; level < TL_WHEEL_LEVELS - 1; level++) {
+		if (delta < (INT64_C(1) << (WHEEL_LEVEL_SHIFT(level) + TL_WHEEL_LEVEL_BITS))) {
+			break;
 		}
-		task = task->next;
 	}
+	return WHEEL_LEVEL_OFFSET(level) + (int) ((expires >> WHEEL_LEVEL_SHIFT(level)) & TL_WHEEL_LEVEL_MASK);
 }
 
-static TLTask* remove_timeout_task(TaskListHandler* hdl, int64_t timeoutTime)
+static void wheel_link(struct TLWheelST* wheel, int slot, TLTask* task)
 {
-	TLTask* task;
-	TLTask* lastTask = NULL;
+	task->prev = NULL;
+	task->next = wheel->slots[slot];
+	if (task->next) {
+		task->next->prev = task;
+	}
+	wheel->slots[slot] = task;
+	task->queueIndex = slot;
+	if (slot < TL_WHEEL_ROOT_SIZE) {
+		wheel->rootCount++;
+	}
+	if (slot != TL_WHEEL_EXPIRED_SLOT) {
+		wheel->count++;
+	}
+}
+
+static void wheel_unlink(struct TLWheelST* wheel, TLTask* task)
+{
+	int slot = task->queueIndex;
+
+	if (task->prev) {
+		task->prev->next = task->next;
+	} else {
+		wheel->slots[slot] = task->next;
+	}
+	if (task->next) {
+		task->next->prev = task->prev;
+	}
+	task->next = NULL;
+	task->prev = NULL;
+	task->queueIndex = -1;
+	if (slot < TL_WHEEL_ROOT_SIZE) {
+		wheel->rootCount--;
+	}
+	if (slot != TL_WHEEL_EXPIRED_SLOT) {
+		wheel->count--;
+	}
+}
+
+static void wheel_insert(struct TLWheelST* wheel, TLTask* task)
+{
+	wheel_link(wheel, wheel_slot_of(wheel, WHEEL_TICK(task->abstime)), task);
+}
+
+/*
+	re-distribute tasks of the slot into lower levels
+*/
+static void wheel_cascade(struct TLWheelST* wheel, int slot)
+{
+	TLTask* task = wheel->slots[slot];
+	TLTask* next;
 
-	task = hdl->tasklist;
 	while (task) {
-		if (task->abstime <= timeoutTime) { // timeout
+		next = task->next;
+		wheel_unlink(wheel, task);
+		wheel_insert(wheel, task);
+		task = next;
+	}
+}
+
+/*
+	process ticks until current, move timeout tasks into expired slot
+*/
+static void wheel_advance(struct TLWheelST* wheel, int64_t current)
+{
+	int idx, level, levelIdx;
+	int64_t next;
+
+	while (wheel->current <= current) {
+		if (wheel->count == 0) { // nothing to cascade, jump directly
+			wheel->current = current + 1;
+			break;
+		}
+		idx = (int) (wheel->current & TL_WHEEL_ROOT_MASK);
+		if (idx == 0) {
+			for (level = 1; level < TL_WHEEL_LEVELS; level++) {
+				levelIdx = (int) ((wheel->current >> WHEEL_LEVEL_SHIFT(level)) & TL_WHEEL_LEVEL_MASK);
+				wheel_cascade(wheel, WHEEL_LEVEL_OFFSET(level) + levelIdx);
+				if (levelIdx != 0) {
+					break;
+				}
+			}
+		}
+		if (wheel->rootCount == 0) { // skip to next cascade
+			next = (wheel->current | TL_WHEEL_ROOT_MASK) + 1;
+			wheel->current = (next <= current)? next: current + 1;
+			continue;
+		}
+		while (wheel->slots[idx]) {
+			TLTask* task = wheel->slots[idx];
+			wheel_unlink(wheel, task);
+			wheel_link(wheel, TL_WHEEL_EXPIRED_SLOT, task);
+		}
+		wheel->current++;
+	}
+}
+
+/*
+	merge two lists sorted by abstime, a goes first for the same abstime
+*/
+static TLTask* task_list_merge(TLTask* a, TLTask* b)
+{
+	TLTask* head = NULL;
+	TLTask** tail = &head;
+
+	while (a && b) {
+		if (b->abstime < a->abstime) {
+			*tail = b;
+			b = b->next;
+		} else {
+			*tail = a;
+			a = a->next;
+		}
+		tail = &(*tail)->next;
+	}
+	*tail = a? a: b;
+	return head;
+}
+
+/*
+	stable bottom-up merge sort by abstime, list is chained by next
+	list is cut into runs that are already sorted, bins[i] holds a sorted
+	list merged from 2^i runs, so a sorted list or a burst of tasks with
+	the same abstime is done in one pass
+*/
+static TLTask* task_list_sort(TLTask* list)
+{
+	TLTask* bins[32];
+	TLTask* carry;
+	TLTask* tail;
+	int i;
+
+	memset(bins, 0, sizeof(bins));
+	while (list) {
+		carry = list;
+		for (tail = list; tail->next && tail->next->abstime >= tail->abstime; tail = tail->next);
+		list = tail->next;
+		tail->next = NULL;
+		for (i = 0; i < 31 && bins[i]; i++) {
+			carry = task_list_merge(bins[i], carry);
+			bins[i] = NULL;
+		}
+		bins[i] = task_list_merge(bins[i], carry);
+	}
+	for (i = 0, list = NULL; i < 32; i++) {
+		list = task_list_merge(bins[i], list);
+	}
+	return list;
+}
+
+/*
+	detach at most maxCount timeout tasks earliest first, 0 for no limit,
+	return them chained by next
+	expired slot is not sorted, tasks are linked to its head in O(1) and
+	the slot is sorted once here, the rest left by maxCount is still one
+	sorted run, so sorting it again is cheap
+*/
+static TLTask* wheel_detach_timeout(struct TLWheelST* wheel, int64_t timeoutTime, int maxCount, int* count)
+{
+	TLTask* runList;
+	TLTask *task, *prev = NULL;
+
+	wheel_advance(wheel, timeoutTime / 1000);
+	runList = task_list_sort(wheel->slots[TL_WHEEL_EXPIRED_SLOT]);
+	wheel->slots[TL_WHEEL_EXPIRED_SLOT] = NULL;
+	for (task = runList; task; prev = task, task = task->next) {
+		if (maxCount > 0 && *count >= maxCount) {
+			prev->next = NULL;
+			break;
+		}
+		task->prev = NULL;
+		task->queueIndex = -1;
+		(*count)++;
+	}
+	if (task) {
+		// put the rest back, prev was broken by sorting
+		wheel->slots[TL_WHEEL_EXPIRED_SLOT] = task;
+		for (prev = NULL; task; prev = task, task = task->next) {
+			task->prev = prev;
+			task->queueIndex = TL_WHEEL_EXPIRED_SLOT;
+		}
+	}
+	return runList;
+}
+
+/*
+	return the next tick that need to be processed, -1 for empty wheel
+	tasks in upper levels are handled at the next cascade
+*/
+static int64_t wheel_next_time(struct TLWheelST* wheel)
+{
+	int idx, i;
+
+	if (wheel->slots[TL_WHEEL_EXPIRED_SLOT]) {
+		return 0; // already timeout
+	}
+	if (wheel->count == 0) {
+		return -1;
+	}
+	idx = (int) (wheel->current & TL_WHEEL_ROOT_MASK);
+	if (idx == 0) {
+		return wheel->current; // cascade of current tick is not done yet
+	}
+	if (wheel->rootCount > 0) {
+		for (i = idx; i < TL_WHEEL_ROOT_SIZE; i++) {
+			if (wheel->slots[i]) {
+				return wheel->current + (i - idx);
+			}
+		}
+	}
+	return (wheel->current | TL_WHEEL_ROOT_MASK) + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Task Queue Utility
+////////////////////////////////////////////////////////////////////////////////
+/*
+	upate minTask, the earliest task is always on the top of heap
+*/
+static void update_min_task(TaskListHandler* hdl)
+{
+	hdl->minTask = (hdl->heapSize > 0)? hdl->heap[0]: NULL;
+}
+
+/*
+	return 0 for success, -1 for out of memory
+*/
+static int queue_insert(TaskListHandler* hdl, TLTask* task)
+{
+	if (hdl->type == TL_TYPE_WHEEL) {
+		if (WHEEL_TICK(task->abstime) < hdl->wheel->current) {
+			// already timeout, sorted when expired slot is detached
+			wheel_link(hdl->wheel, TL_WHEEL_EXPIRED_SLOT, task);
+		} else {
+			wheel_insert(hdl->wheel, task);
+		}
+	} else {
+		if (heap_reserve(hdl, hdl->heapSize + 1) != 0) {
+			return -1;
+		}
+		heap_push(hdl, task);
+		update_min_task(hdl);
+	}
+	hdl->taskCount++;
+	return 0;
+}
+
+static void queue_remove(TaskListHandler* hdl, TLTask* task)
+{
+	if (hdl->type == TL_TYPE_WHEEL) {
+		wheel_unlink(hdl->wheel, task);
+	} else {
+		heap_remove(hdl, task);
+		update_min_task(hdl);
+	}
+	hdl->taskCount--;
+}
+
+/*
+	detach at most maxCount tasks that abstime <= timeoutTime, 0 for no limit
+	return them chained by next, earliest first
+*/
+static TLTask* queue_detach_timeout(TaskListHandler* hdl, int64_t timeoutTime, int maxCount)
+{
+	TLTask *runList = NULL, *lastTask = NULL, *task;
+	int count = 0;
+
+	if (hdl->type == TL_TYPE_WHEEL) {
+		runList = wheel_detach_timeout(hdl->wheel, timeoutTime, maxCount, &count);
+	} else {
+		while (hdl->heapSize > 0 && hdl->heap[0]->abstime <= timeoutTime &&
+				(maxCount <= 0 || count < maxCount)) {
+			task = hdl->heap[0];
+			heap_remove(hdl, task);
+			task->next = NULL;
 			if (lastTask) {
-				lastTask->next = task->next;
+				lastTask->next = task;
 			} else {
-				hdl->tasklist = task->next;
+				runList = task;
 			}
-			task->next = NULL;
-			// check minTask
-			if (hdl->minTask == task) {
-				update_min_task(hdl);
-				// doesn't need to notify minTask change, because timeout will re-caculate after do_task()
+			lastTask = task;
+			count++;
+		}
+		update_min_task(hdl);
+	}
+	hdl->taskCount -= count;
+	return runList;
+}
+
+/*
+	return usec of TL_CLOCK that loop should wake up, -1 for no task
+*/
+static int64_t queue_next_time(TaskListHandler* hdl)
+{
+	int64_t tick;
+
+	if (hdl->type == TL_TYPE_WHEEL) {
+		tick = wheel_next_time(hdl->wheel);
+		return (tick < 0)? -1: tick * 1000;
+	}
+	if (!hdl->minTask) {
+		return -1;
+	}
+	// task added with a time before boot is already timeout, not "no task"
+	return (hdl->minTask->abstime < 0)? 0: hdl->minTask->abstime;
+}
+
+/*
+	call itfunc for each queued task until it return TL_IT_BREAK
+	itfunc must not remove task from queue
+*/
+static int queue_foreach(TaskListHandler* hdl, TLIteratorTaskFunc itfunc, void* itdata)
+{
+	int ret = 0;
+	int i;
+	TLTask *task, *next;
+
+	if (hdl->type == TL_TYPE_WHEEL) {
+		for (i = 0; i <= TL_WHEEL_EXPIRED_SLOT; i++) {
+			for (task = hdl->wheel->slots[i]; task; task = next) {
+				next = task->next; // task may be freed by release_all_task()
+				ret = itfunc(task, itdata);
+				if (ret == TL_IT_BREAK) {
+					return ret;
+				}
+			}
+		}
+	} else {
+		for (i = 0; i < hdl->heapSize; i++) {
+			ret = itfunc(hdl->heap[i], itdata);
+			if (ret == TL_IT_BREAK) {
+				return ret;
 			}
-			return task;
 		}
-		lastTask = task;
-		task = task->next;
 	}
-	return NULL;
+	return ret;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Stats Utility
+////////////////////////////////////////////////////////////////////////////////
+#define TL_CACHE_LINE	64
+#define TL_STATS_SLOTS	16 // threads share a slot while there are more threads
 
-static void do_task(TaskListHandler* hdl)
+/*
+	counters updated by threads using the slot, padded so different slots
+	are never in the same cache line
+*/
+struct TLStatsSlotST {
+	char pad0[TL_CACHE_LINE];
+	uint64_t adds;
+	uint64_t cancels;
+	uint64_t fires;
+	uint64_t lockCount;
+	uint64_t lockContended;
+	uint64_t lateness[TL_STATS_BUCKETS];
+	uint64_t execTime[TL_STATS_BUCKETS];
+};
+
+struct TLStatsST {
+	int64_t startTime; // usec of TL_CLOCK
+	int maxTaskCount; // updated under listLock
+	struct TLStatsSlotST slots[TL_STATS_SLOTS];
+};
+
+static int lastStatsSlot;
+static TL_THREAD_LOCAL int statsSlot; // slot index + 1, 0 for not assigned
+
+static struct TLStatsSlotST* stats_slot(struct TLStatsST* stats)
 {
-	int64_t timeoutTime = get_current_ms_time();
-	TLTask* task;
-	task = remove_timeout_task(hdl, timeoutTime);
+	if (!statsSlot) {
+		statsSlot = __atomic_add_fetch(&lastStatsSlot, 1, __ATOMIC_RELAXED) % TL_STATS_SLOTS + 1;
+	}
+	return &stats->slots[statsSlot - 1];
+}
 
-	while (task) {
-		pthread_mutex_unlock(&hdl->listLock); // unlock, so do_task can call tl_xxx function
-		LOGD("do_task %p", task->taskFunc);
+static void stats_add(uint64_t* counter, uint64_t value)
+{
+	__atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
 
-		if (task->taskFunc) {
-			task->taskFunc(hdl, task->taskdata);
-		}
-		free(task); // free, since we have done the task
-		
-		pthread_mutex_lock(&hdl->listLock); // lock again, because 
-		task = remove_timeout_task(hdl, timeoutTime);
+static void stats_count_add(TaskListHandler* hdl, int count)
+{
+	if (hdl->stats) {
+		stats_add(&stats_slot(hdl->stats)->adds, count);
+	}
+}
+
+static void stats_count_cancel(TaskListHandler* hdl)
+{
+	if (hdl->stats) {
+		stats_add(&stats_slot(hdl->stats)->cancels, 1);
 	}
 }
 
 /*
-	return minum task abstime time, if not found, return 36000
+	log2 histogram bucket of usec
+*/
+static int stats_bucket(int64_t us)
+{
+	int bucket;
+
+	if (us <= 0) {
+		return 0;
+	}
+	bucket = 64 - __builtin_clzll((uint64_t) us);
+	return bucket < TL_STATS_BUCKETS? bucket: TL_STATS_BUCKETS - 1;
+}
+
+/*
+	lock listLock, count contention while stats is enabled
+*/
+static void lock_list(TaskListHandler* hdl)
+{
+	struct TLStatsSlotST* slot;
+
+	if (!hdl->stats) {
+		pthread_mutex_lock(&hdl->listLock);
+		return;
+	}
+	slot = stats_slot(hdl->stats);
+	if (pthread_mutex_trylock(&hdl->listLock) != 0) {
+		stats_add(&slot->lockContended, 1);
+		pthread_mutex_lock(&hdl->listLock);
+	}
+	stats_add(&slot->lockCount, 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Worker Utility
+////////////////////////////////////////////////////////////////////////////////
+struct TLWorkersST {
+	int count;
+	pthread_t* threads;
+	int* cpus; // NULL for no pinning
+	int cpuCount;
+	LUHandler* queue; // LU_TYPE_BLOCK_QUEUE of TLTask waiting for worker
+};
+
+/*
+	callbacks get the sharded handler instead of the shard
+*/
+static TaskListHandler* user_handler(TaskListHandler* hdl)
+{
+	return hdl->parent? hdl->parent: hdl;
+}
+
+/*
+	run callback, then re-arm periodic task or free one-shot task
+*/
+static void run_task(TaskListHandler* hdl, TLTask* task)
+{
+	struct TLStatsSlotST* slot = NULL;
+	int64_t overrun = 0;
+	int64_t start = 0;
+	int64_t abstime;
+	int state = TL_TASK_PENDING;
+	int rearm;
+
+	LOGD("do_task %p", task->taskFunc);
+
+	// a cancel before this point wins, task is untracked and callback is skipped
+	if (!__atomic_compare_exchange_n(&task->state, &state, TL_TASK_RUNNING, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		mempool_free(hdl->taskPool, task);
+		return;
+	}
+	if (hdl->stats) {
+		slot = stats_slot(hdl->stats);
+		start = get_current_us_time();
+		stats_add(&slot->fires, 1);
+		stats_add(&slot->lateness[stats_bucket(start - task->abstime)], 1);
+	}
+	if (task->period > 0) {
+		// next time stays on the grid of first time, late runs skip missed periods
+		overrun = ((start? start: get_current_us_time()) - task->abstime) / task->period;
+		if (overrun < 0) {
+			overrun = 0;
+		}
+	}
+	if (task->taskFunc) {
+		taskOverrun = overrun;
+		currentTask = task;
+		task->taskFunc(user_handler(hdl), task->taskdata);
+		currentTask = NULL;
+		taskOverrun = 0;
+	}
+	if (slot) {
+		stats_add(&slot->execTime[stats_bucket(get_current_us_time() - start)], 1);
+	}
+
+	rearm = (task->period > 0);
+	if (task->taskId) {
+		// tracked task can be cancelled while running, state is changed under listLock
+		lock_list(hdl);
+		rearm = rearm && (task->state == TL_TASK_RUNNING);
+		if (rearm) {
+			__atomic_store_n(&task->state, TL_TASK_PENDING, __ATOMIC_RELEASE);
+		} else {
+			if (hdl->taskIds && idmap_get(hdl->taskIds, task->taskId) == task) {
+				untrack_task(hdl, task);
+			}
+			__atomic_store_n(&task->state, TL_TASK_DONE, __ATOMIC_RELEASE);
+		}
+		if (hdl->syncWaiters > 0) {
+			pthread_cond_broadcast(&hdl->doneCond);
+		}
+		pthread_mutex_unlock(&hdl->listLock);
+	} else if (rearm) {
+		__atomic_store_n(&task->state, TL_TASK_PENDING, __ATOMIC_RELEASE);
+	}
+	if (rearm) {
+		// still in id map, if it is cancelled from now on, drain_inbox() frees it,
+		// so task is not touched after it is pushed
+		task->abstime += (overrun + 1) * task->period;
+		abstime = task->abstime;
+		inbox_push(hdl, task, task);
+		wakeup_loop(hdl, abstime);
+		return;
+	}
+	mempool_free(hdl->taskPool, task); // free, since we have done the task
+}
+
+static void* worker_loop(void* param)
+{
+	TaskListHandler* hdl = (TaskListHandler*) param;
+	struct TLWorkersST* workers = hdl->workers;
+	TLTask* task;
+
+	while (1) {
+		task = (TLTask*) lu_dequeue(workers->queue);
+		if (!task) { // NULL for closed queue or wake up without task
+			if (lu_is_closed(workers->queue)) {
+				break;
+			}
+			continue;
+		}
+		run_task(hdl, task);
+	}
+	return NULL;
+}
+
+static void pin_worker(struct TLWorkersST* workers, int idx)
+{
+#ifdef __linux__
+	cpu_set_t cpuset;
+
+	if (!workers->cpus || workers->cpuCount <= 0) {
+		return;
+	}
+	CPU_ZERO(&cpuset);
+	CPU_SET(workers->cpus[idx % workers->cpuCount], &cpuset);
+	if (pthread_setaffinity_np(workers->threads[idx], sizeof(cpuset), &cpuset) != 0) {
+		LOGE("pin worker %d to cpu %d fail", idx, workers->cpus[idx % workers->cpuCount]);
+	}
+#endif
+}
+
+static int start_workers(TaskListHandler* hdl)
+{
+	struct TLWorkersST* workers = hdl->workers;
+	int i;
+
+	workers->queue = lu_create_list(LU_TYPE_BLOCK_QUEUE);
+	if (!workers->queue) {
+		return -1;
+	}
+	for (i = 0; i < workers->count; i++) {
+		pthread_create(&workers->threads[i], NULL, worker_loop, hdl);
+		pin_worker(workers, i);
+	}
+	return 0;
+}
+
+/*
+	wait all queued tasks done and stop workers
+*/
+static void stop_workers(TaskListHandler* hdl)
+{
+	struct TLWorkersST* workers = hdl->workers;
+	int i;
+
+	if (!workers->queue) {
+		return;
+	}
+	// workers run the queued tasks before they see the closed empty queue
+	lu_close(workers->queue);
+	for (i = 0; i < workers->count; i++) {
+		pthread_join(workers->threads[i], NULL);
+	}
+	lu_release_list(workers->queue);
+	workers->queue = NULL;
+}
+
+static void release_workers(TaskListHandler* hdl)
+{
+	if (!hdl->workers) {
+		return;
+	}
+	free(hdl->workers->threads);
+	free(hdl->workers->cpus);
+	free(hdl->workers);
+	hdl->workers = NULL;
+}
+
+/*
+	job of executor, see tl_set_executor()
+*/
+static void exec_task(void* jobctx, void* jobdata)
+{
+	TaskListHandler* hdl = (TaskListHandler*) jobctx;
+
+	run_task(hdl, (TLTask*) jobdata);
+	// decrease under listLock, so wait_executor() can't return and release
+	// hdl before the last job unlocks
+	pthread_mutex_lock(&hdl->listLock);
+	if (__atomic_sub_fetch(&hdl->executorPending, 1, __ATOMIC_RELEASE) == 0) {
+		pthread_cond_broadcast(&hdl->doneCond);
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+}
+
+/*
+	wait tasks submitted to executor done, so handler can be stopped
+*/
+static void wait_executor(TaskListHandler* hdl)
+{
+	pthread_mutex_lock(&hdl->listLock);
+	while (__atomic_load_n(&hdl->executorPending, __ATOMIC_ACQUIRE) > 0) {
+		pthread_cond_wait(&hdl->doneCond, &hdl->listLock);
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+}
+
+/*
+	run task in executor or worker if there is, else run it in current thread
+*/
+static void dispatch_task(TaskListHandler* hdl, TLTask* task)
+{
+	task->next = NULL;
+	if (hdl->executor) {
+		__atomic_add_fetch(&hdl->executorPending, 1, __ATOMIC_RELAXED);
+		if (ex_submit(hdl->executor, exec_task, hdl, task) == 0) {
+			return;
+		}
+		__atomic_sub_fetch(&hdl->executorPending, 1, __ATOMIC_RELAXED);
+		LOGE("dispatch_task: ex_submit fail, run in loop thread");
+	}
+	if (hdl->workers && hdl->workers->queue) {
+		if (lu_enqueue(hdl->workers->queue, task) == 0) {
+			return;
+		}
+		LOGE("dispatch_task: lu_enqueue fail, run in loop thread");
+	}
+	run_task(hdl, task);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Poll Mode Utility
+////////////////////////////////////////////////////////////////////////////////
+struct TLPollST {
+	int epollFd; // returned by tl_get_poll_fd()
+	int timerFd; // armed at waitTime
+	int eventFd; // written instead of signaling listCond
+};
+
+static void close_poll(struct TLPollST* poll)
+{
+	if (poll->epollFd >= 0) {
+		close(poll->epollFd);
+	}
+	if (poll->timerFd >= 0) {
+		close(poll->timerFd);
+	}
+	if (poll->eventFd >= 0) {
+		close(poll->eventFd);
+	}
+	free(poll);
+}
+
+#ifdef __linux__
+static struct TLPollST* open_poll(void)
+{
+	struct TLPollST* poll = (struct TLPollST*) malloc(sizeof(struct TLPollST));
+	struct epoll_event ev;
+
+	if (!poll) {
+		return NULL;
+	}
+	poll->timerFd = timerfd_create(TL_CLOCK, TFD_NONBLOCK | TFD_CLOEXEC);
+	poll->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	poll->epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (poll->timerFd < 0 || poll->eventFd < 0 || poll->epollFd < 0) {
+		close_poll(poll);
+		return NULL;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = poll->timerFd;
+	if (epoll_ctl(poll->epollFd, EPOLL_CTL_ADD, poll->timerFd, &ev) != 0) {
+		close_poll(poll);
+		return NULL;
+	}
+	ev.data.fd = poll->eventFd;
+	if (epoll_ctl(poll->epollFd, EPOLL_CTL_ADD, poll->eventFd, &ev) != 0) {
+		close_poll(poll);
+		return NULL;
+	}
+	return poll;
+}
+
+/*
+	arm timerFd at abstime of TL_CLOCK, -1 for disarm
+*/
+static void arm_poll(struct TLPollST* poll, int64_t abstime)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (abstime >= 0) {
+		if (abstime == 0) {
+			abstime = 1; // 0 disarms the timer
+		}
+		its.it_value.tv_sec = abstime / 1000000;
+		its.it_value.tv_nsec = (abstime % 1000000) * 1000;
+	}
+	if (timerfd_settime(poll->timerFd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+		LOGE("arm_poll: timerfd_settime fail, errno=%d", errno);
+	}
+}
+
+/*
+	read fds until they are not readable
+*/
+static void clear_poll(struct TLPollST* poll)
+{
+	uint64_t value;
+
+	while (read(poll->timerFd, &value, sizeof(value)) > 0);
+	while (read(poll->eventFd, &value, sizeof(value)) > 0);
+}
+#endif
+
+/*
+	trigger interrupt to re-calculate timeout time, caller must hold listLock
+*/
+static void notify_loop(TaskListHandler* hdl)
+{
+#ifdef __linux__
+	uint64_t value = 1;
+
+	if (hdl->poll) {
+		if (write(hdl->poll->eventFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+			LOGE("notify_loop: write eventfd fail, errno=%d", errno);
+		}
+		return;
+	}
+#endif
+	pthread_cond_signal(&hdl->listCond);
+}
+
+/*
+	stop workers and close fds of poll mode
+*/
+static void release_poll(TaskListHandler* hdl)
+{
+	if (!hdl->poll) {
+		return;
+	}
+	if (hdl->workers) {
+		stop_workers(hdl);
+	}
+	wait_executor(hdl);
+	close_poll(hdl->poll);
+	hdl->poll = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Task List Utility
+////////////////////////////////////////////////////////////////////////////////
+/*
+	add task to id map, so it can be found by id
+	return 0 for success, -1 for out of memory
+*/
+static int track_task(TaskListHandler* hdl, TLTask* task)
+{
+	if (!task->taskId) {
+		return 0;
+	}
+	if (!hdl->taskIds) {
+		hdl->taskIds = (IdMap*) malloc(sizeof(IdMap));
+		if (hdl->taskIds && idmap_init(hdl->taskIds, 0) != 0) {
+			free(hdl->taskIds);
+			hdl->taskIds = NULL;
+		}
+		if (!hdl->taskIds) {
+			return -1;
+		}
+	}
+	return idmap_put(hdl->taskIds, task->taskId, task);
+}
+
+/*
+	remove task from id map, task can not be found by id anymore
+*/
+static void untrack_task(TaskListHandler* hdl, TLTask* task)
+{
+	if (task->taskId && hdl->taskIds) {
+		idmap_remove(hdl->taskIds, task->taskId);
+	}
+}
+
+/*
+	push task chain first..last to inbox without listLock,
+	it's safe for multiple producers
+*/
+static void inbox_push(TaskListHandler* hdl, TLTask* first, TLTask* last)
+{
+	TLTask* head = __atomic_load_n(&hdl->inbox, __ATOMIC_RELAXED);
+
+	do {
+		last->next = head;
+	} while (!__atomic_compare_exchange_n(&hdl->inbox, &head, first, 1,
+				__ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+}
+
+#define TL_BUDGET_BATCH		64 // tasks detached at once while only time budget is set
+
+/*
+	put task that is not in queue back, caller must hold listLock
+	there is nobody to report to, task is dropped for out of memory
+*/
+static void requeue_task(TaskListHandler* hdl, TLTask* task)
+{
+	task->next = NULL;
+	if (__atomic_load_n(&task->state, __ATOMIC_ACQUIRE) == TL_TASK_CANCELLED) {
+		// cancelled while it was out of queue
+		mempool_free(hdl->taskPool, task);
+		return;
+	}
+	if (track_task(hdl, task) != 0 || queue_insert(hdl, task) != 0) {
+		untrack_task(hdl, task);
+		LOGE("requeue_task: out of memory, drop task %p", task->taskFunc);
+		mempool_free(hdl->taskPool, task);
+	}
+}
+
+/*
+	move all tasks in inbox to queue, caller must hold listLock
+*/
+static void drain_inbox(TaskListHandler* hdl)
+{
+	TLTask* list;
+	TLTask* task;
+
+	if (!__atomic_load_n(&hdl->inbox, __ATOMIC_RELAXED)) {
+		return;
+	}
+	list = __atomic_exchange_n(&hdl->inbox, NULL, __ATOMIC_ACQUIRE);
+	while (list) {
+		task = list;
+		list = task->next;
+		requeue_task(hdl, task);
+	}
+	if (hdl->stats && hdl->taskCount > hdl->stats->maxTaskCount) {
+		hdl->stats->maxTaskCount = hdl->taskCount;
+	}
+}
+
+/*
+	lock listLock and move tasks in inbox to queue, so caller can see all tasks
+*/
+static void lock_task_list(TaskListHandler* hdl)
+{
+	lock_list(hdl);
+	drain_inbox(hdl);
+}
+
+/*
+	wake up loop if task is earlier than the time loop is waiting for
+	only the producer that lowers waitTime signals, the others know the
+	loop will wake up earlier than their tasks
+*/
+static void wakeup_loop(TaskListHandler* hdl, int64_t abstime)
+{
+	int64_t waitTime = __atomic_load_n(&hdl->waitTime, __ATOMIC_SEQ_CST);
+
+	// task can wait until the end of its slack window
+	abstime += __atomic_load_n(&hdl->slack, __ATOMIC_RELAXED);
+
+	while (abstime < waitTime) {
+		if (__atomic_compare_exchange_n(&hdl->waitTime, &waitTime, abstime, 0,
+					__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			lock_list(hdl);
+			notify_loop(hdl);
+			pthread_mutex_unlock(&hdl->listLock);
+			break;
+		}
+	}
+}
+
+/*
+	tasks stay in id map until their callbacks return, so they can be
+	cancelled before callbacks start, see cancel_task()
+*/
+static TLTask* remove_timeout_tasks(TaskListHandler* hdl, int64_t timeoutTime, int maxCount)
+{
+	// doesn't need to notify minTask change, because timeout will re-caculate after do_task()
+	return queue_detach_timeout(hdl, timeoutTime, maxCount);
+}
+
+/*
+	remove task from queue, and notify loop if minTask is changed
+*/
+static void remove_task(TaskListHandler* hdl, TLTask* task)
+{
+	int isMinTask = (hdl->minTask == task);
+
+	untrack_task(hdl, task);
+	queue_remove(hdl, task);
+	if (isMinTask) {
+		notify_loop(hdl);
+	}
+}
+
+/*
+	Detach timeout tasks into a local run list under listLock, earliest
+	first, then run or dispatch them to workers without listLock.
+	Tasks in run list are not in the queue anymore, so they can not be
+	found by tl_find_task()/tl_iterator_task(), only tasks with id can be
+	cancelled until their callbacks start.
+	With run budget, the rest of timeout tasks are left in queue, the loop
+	comes back at once and picks the earliest of them and new added tasks.
+*/
+static void do_task(TaskListHandler* hdl)
+{
+	int64_t timeoutTime = get_current_us_time(); // one clock read for whole run list
+	int64_t budgetTime = hdl->budgetTime;
+	int maxCount = hdl->budgetTasks;
+	int outOfTime = 0;
+	TLTask* runList;
+	TLTask* task;
+
+	drain_inbox(hdl);
+	if (budgetTime > 0 && maxCount == 0) {
+		maxCount = TL_BUDGET_BATCH; // detach in batches, so only a few are put back
+	}
+	do {
+		runList = remove_timeout_tasks(hdl, timeoutTime, maxCount);
+		if (!runList) {
+			break;
+		}
+		pthread_mutex_unlock(&hdl->listLock); // unlock, so do_task can call tl_xxx function
+		while (runList) {
+			task = runList;
+			runList = task->next;
+			dispatch_task(hdl, task);
+			if (budgetTime > 0 && get_current_us_time() - timeoutTime >= budgetTime) {
+				outOfTime = 1;
+				break;
+			}
+		}
+		lock_list(hdl); // lock again, caller will unlock it
+		// put back tasks not run in time budget, from the last one
+		for (task = NULL; runList; ) {
+			TLTask* next = runList->next;
+			runList->next = task;
+			task = runList;
+			runList = next;
+		}
+		while (task) {
+			runList = task->next;
+			requeue_task(hdl, task);
+			task = runList;
+		}
+	} while (budgetTime > 0 && hdl->budgetTasks == 0 && !outOfTime);
+}
+
+/*
+	return minum task time + slack of TL_CLOCK, if not found, return 2036 year
+	tasks due in the slack window are run together when loop wakes up
+	return value is the same time in usec, -1 for not found
+*/
+static int64_t get_next_timeout_time(TaskListHandler* hdl, struct timespec* ts)
+{
+	int64_t current = get_current_us_time();
+	int64_t abstime = queue_next_time(hdl);
+
+	ts->tv_sec = 2100000000; // 2036 year
+	ts->tv_nsec = 0;
+	if (abstime < 0) {
+		__atomic_store_n(&hdl->waitTime, INT64_MAX, __ATOMIC_SEQ_CST);
+		return -1;
+	}
+	abstime += hdl->slack;
+	__atomic_store_n(&hdl->waitTime, abstime, __ATOMIC_SEQ_CST);
+	if (abstime <= current) {
+		ts->tv_sec = 0;
+		ts->tv_nsec = 0;
+	} else {
+		ts->tv_sec = abstime / 1000000;
+		ts->tv_nsec = (abstime % 1000000) * 1000;
+	}
+	return abstime;
+}
+
+static int dump_task(TaskListHandler* hdl, TLTaskSnapshot* task, void* dumpdata)
+{
+	struct TASK_DUMP_ST* dumpst = (struct TASK_DUMP_ST*) dumpdata;
+	char* str = NULL;
+	struct tm timeinfo;
+	int64_t abstime = clock_time_to_abstime(task->abstime);
+	time_t rawtime = (time_t) abstime / 1000;
+
+	localtime_r(&rawtime, &timeinfo);
+
+	dumpst->count++;
+	LOGI("TASK %d(%p): abstime=%" PRId64 "(%04d-%02d-%02d %02d:%02d:%02d %d), taskFunc=%p",
+			dumpst->count, task->task, abstime,
+			timeinfo.tm_year+1900, timeinfo.tm_mon+1, timeinfo.tm_mday,
+			timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec,
+			timeinfo.tm_wday,
+			task->taskFunc);
+
+	if (dumpst->dumpFunc) {
+		dumpst->strBuf[sizeof(dumpst->strBuf)-1] = '\0'; // null end of strBuf
+		str = dumpst->dumpFunc(task->taskdata, dumpst->strBuf, sizeof(dumpst->strBuf)-1); // -1 to avoid null end be overwrite
+		if (str) {
+			LOGI("\tData in Task: %s", str);
+		}
+	}
+
+	return 0;
+}
+
+static void release_all_task(TaskListHandler* hdl)
+{
+	TLTask* list;
+	TLTask* task;
+	int i;
+
+	pthread_mutex_lock(&hdl->listLock);
+	// taskPool is shared by all handlers, give tasks back one by one
+	list = __atomic_exchange_n(&hdl->inbox, NULL, __ATOMIC_ACQUIRE);
+	while (list) {
+		task = list;
+		list = task->next;
+		mempool_free(hdl->taskPool, task);
+	}
+	if (hdl->wheel) {
+		for (i = 0; i <= TL_WHEEL_EXPIRED_SLOT; i++) {
+			while (hdl->wheel->slots[i]) {
+				task = hdl->wheel->slots[i];
+				hdl->wheel->slots[i] = task->next;
+				mempool_free(hdl->taskPool, task);
+			}
+		}
+		hdl->wheel->count = 0;
+		hdl->wheel->rootCount = 0;
+	}
+	for (i = 0; i < hdl->heapSize; i++) {
+		mempool_free(hdl->taskPool, hdl->heap[i]);
+	}
+	free(hdl->heap);
+	hdl->heap = NULL;
+	hdl->heapSize = 0;
+	hdl->heapCapacity = 0;
+	hdl->minTask = NULL;
+	hdl->taskCount = 0;
+	if (hdl->taskIds) {
+		idmap_destroy(hdl->taskIds);
+		free(hdl->taskIds);
+		hdl->taskIds = NULL;
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+}
+
+static int snapshot_task(TLTask* task, void* itdata)
+{
+	struct TASK_SNAPSHOT_ST* snapst = (struct TASK_SNAPSHOT_ST*) itdata;
+	TLTaskSnapshot* snap;
+
+	if (snapst->count == snapst->capacity) {
+		return TL_IT_BREAK; // never, capacity is taskCount
+	}
+	snap = &snapst->snaps[snapst->count++];
+	snap->task = task;
+	snap->taskFunc = task->taskFunc;
+	snap->taskdata = task->taskdata;
+	snap->abstime = task->abstime;
+	return TL_IT_CONTINUE;
+}
+
+/*
+	do function for each task in a copy of taslist, listLock is only held
+	while copying, so itfunc doesn't block the loop and adding threads
+	shards are copied and iterated one by one
+*/
+static int iterator_snapshot(TaskListHandler* hdl, TLIteratorSnapshotFunc itfunc, void* itdata)
+{
+	struct TASK_SNAPSHOT_ST snapst;
+	int ret = 0;
+	int i;
+
+	if (!itfunc) {
+		return -1;
+	}
+	if (hdl->shards) {
+		for (i = 0; i < hdl->shardCount && ret != TL_IT_BREAK; i++) {
+			ret = iterator_snapshot(hdl->shards[i], itfunc, itdata);
+		}
+		return ret;
+	}
+
+	memset(&snapst, 0, sizeof(snapst));
+	lock_task_list(hdl);
+	if (hdl->taskCount > 0) {
+		snapst.snaps = (TLTaskSnapshot*) malloc(hdl->taskCount * sizeof(TLTaskSnapshot));
+		if (!snapst.snaps) {
+			pthread_mutex_unlock(&hdl->listLock);
+			LOGE("iterator_snapshot: snaps == NULL");
+			return -1;
+		}
+		snapst.capacity = hdl->taskCount;
+		queue_foreach(hdl, snapshot_task, &snapst);
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+
+	for (i = 0; i < snapst.count; i++) {
+		ret = itfunc(hdl, &snapst.snaps[i], itdata);
+		if (ret == TL_IT_BREAK) {
+			break;
+		}
+	}
+	free(snapst.snaps);
+	return ret;
+}
+
+/*
+	call user TLIteratorFunc with the copied task
+*/
+static int iterator_user_snapshot(TaskListHandler* hdl, TLTaskSnapshot* snap, void* itdata)
+{
+	struct TASK_USER_SNAPSHOT_ST* userst = (struct TASK_USER_SNAPSHOT_ST*) itdata;
+
+	return (userst->itfunc(user_handler(hdl), snap->taskdata, userst->itdata) == TL_IT_BREAK)? TL_IT_BREAK: TL_IT_CONTINUE;
+}
+
+/*
+	call user TLIteratorFunc and collect tasks to remove
+*/
+static int iterator_user_task(TLTask* task, void* itdata)
+{
+	struct TASK_ITERATOR_ST* itst = (struct TASK_ITERATOR_ST*) itdata;
+	TLTask** tasks;
+	int ret;
+
+	ret = itst->itfunc(user_handler(itst->hdl), task->taskdata, itst->itdata);
+	itst->ret = ret;
+	if (ret == TL_IT_REMOVE || ret == TL_IT_REMOVE_BREAK) {
+		if (itst->removeCount == itst->removeCapacity) {
+			int capacity = itst->removeCapacity? itst->removeCapacity * 2: 16;
+			tasks = (TLTask**) realloc(itst->removeTasks, capacity * sizeof(TLTask*));
+			if (!tasks) {
+				LOGE("tl_iterator_task: removeTasks == NULL");
+				return TL_IT_BREAK;
+			}
+			itst->removeTasks = tasks;
+			itst->removeCapacity = capacity;
+		}
+		itst->removeTasks[itst->removeCount++] = task;
+		if (ret == TL_IT_REMOVE_BREAK) {
+			return TL_IT_BREAK;
+		}
+	}
+	return ret;
+}
+
+static int match_task(TLTask* task, void* itdata)
+{
+	struct TASK_MATCH_ST* matchst = (struct TASK_MATCH_ST*) itdata;
+
+	if (matchst->matchFunc(task->taskdata, matchst->matchdata) == TL_IT_MATCH) {
+		matchst->found = task;
+		return TL_IT_BREAK;
+	}
+	return TL_IT_CONTINUE;
+}
+
+/*
+	return the first matched task, caller must hold listLock
+*/
+static TLTask* find_task(TaskListHandler* hdl, TLMatchFunc matchFunc, void* matchdata)
+{
+	struct TASK_MATCH_ST matchst;
+
+	matchst.matchFunc = matchFunc;
+	matchst.matchdata = matchdata;
+	matchst.found = NULL;
+	queue_foreach(hdl, match_task, &matchst);
+	return matchst.found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Shard Utility
+////////////////////////////////////////////////////////////////////////////////
+/*
+	new task goes to the shard of current cpu, so producers on different
+	cpus don't contend on the same listLock
+*/
+static TaskListHandler* select_shard(TaskListHandler* hdl)
+{
+#ifdef __linux__
+	int cpu = sched_getcpu();
+	if (cpu >= 0) {
+		return hdl->shards[cpu % hdl->shardCount];
+	}
+#endif
+	return hdl->shards[((uintptr_t) pthread_self() >> 4) % hdl->shardCount];
+}
+
+/*
+	return NULL for invalid id
+*/
+static TaskListHandler* shard_of_task_id(TaskListHandler* hdl, TLTaskId taskId)
+{
+	int idx = (int) (taskId & (TL_MAX_SHARDS - 1));
+
+	if (idx >= hdl->shardCount) {
+		return NULL;
+	}
+	return hdl->shards[idx];
+}
+
+/*
+	Add a new task to task list
+*/
+static int add_task(TaskListHandler* hdl,
+			    int64_t clockTime, // usec of TL_CLOCK. time to invoke the callback function
+			    int64_t period, // usec, 0 for one-shot task
+			    TLTaskFunc taskFunc, // callback function
+			    void* taskdata, // data for func
+			    TLTaskId* taskId)
+{
+	TLTask *task;
+
+	if (hdl->shards) {
+		return add_task(select_shard(hdl), clockTime, period, taskFunc, taskdata, taskId);
+	}
+
+	task = (TLTask*) mempool_alloc(hdl->taskPool);
+	if (!task) {
+		LOGE("tl_add_task: task == NULL");
+		return -1;
+	}
+
+	// init task
+	task->abstime = clockTime;
+	task->period = period;
+	task->taskFunc = taskFunc;
+	task->taskdata = taskdata;
+	task->queueIndex = -1;
+	if (taskId) {
+		task->taskId = (__atomic_add_fetch(&hdl->lastTaskId, 1, __ATOMIC_RELAXED) << TL_SHARD_BITS) | hdl->shardIndex;
+		*taskId = task->taskId;
+	}
+
+	stats_count_add(hdl, 1);
+	// listLock holder moves it to queue, the loop or tl_xxx function
+	inbox_push(hdl, task, task);
+	wakeup_loop(hdl, clockTime);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Task List Export Function
+////////////////////////////////////////////////////////////////////////////////
+/*
+	return NULL for fail
+*/
+TaskListHandler* tl_create_handler_with_type(int type)
+{
+	TaskListHandler* hdl = (TaskListHandler*) malloc(sizeof(TaskListHandler));
+	if (!hdl)
+		return NULL;
+	
+	memset(hdl, 0, sizeof(TaskListHandler));
+	hdl->type = type;
+	hdl->waitTime = INT64_MAX;
+	hdl->taskPool = mempool_shared(sizeof(TLTask));
+	if (!hdl->taskPool) {
+		free(hdl);
+		return NULL;
+	}
+	if (type == TL_TYPE_WHEEL) {
+		hdl->wheel = (struct TLWheelST*) calloc(1, sizeof(struct TLWheelST));
+		if (!hdl->wheel) {
+			free(hdl);
+			return NULL;
+		}
+		hdl->wheel->current = get_current_us_time() / 1000;
+	}
+	pthread_mutex_init(&hdl->listLock, NULL);
+	pthread_cond_init(&hdl->doneCond, NULL);
+#ifdef WIN32
+	pthread_cond_init(&hdl->listCond, NULL);
+#else
+	{
+		// loop waits on TL_CLOCK deadline
+		pthread_condattr_t attr;
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, TL_CLOCK);
+		pthread_cond_init(&hdl->listCond, &attr);
+		pthread_condattr_destroy(&attr);
+	}
+#endif
+
+	return hdl;
+}
+
+TaskListHandler* tl_create_handler()
+{
+	return tl_create_handler_with_type(TL_TYPE_HEAP);
+}
+
+/*
+	return NULL for fail
+*/
+TaskListHandler* tl_create_sharded_handler(int type, int shardCount)
+{
+	TaskListHandler* hdl;
+	int i;
+
+	if (shardCount <= 0) {
+		shardCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+		if (shardCount <= 0) {
+			shardCount = 1;
+		}
+	}
+	if (shardCount > TL_MAX_SHARDS) {
+		shardCount = TL_MAX_SHARDS;
+	}
+
+	// the sharded handler itself never holds task, its queue is always empty
+	hdl = tl_create_handler_with_type(type);
+	if (!hdl)
+		return NULL;
+	hdl->shards = (TaskListHandler**) calloc(shardCount, sizeof(TaskListHandler*));
+	if (!hdl->shards) {
+		tl_release_handler(hdl);
+		return NULL;
+	}
+	hdl->shardCount = shardCount;
+	for (i = 0; i < shardCount; i++) {
+		hdl->shards[i] = tl_create_handler_with_type(type);
+		if (!hdl->shards[i]) {
+			tl_release_handler(hdl);
+			return NULL;
+		}
+		hdl->shards[i]->shardIndex = i;
+		hdl->shards[i]->parent = hdl;
+	}
+	return hdl;
+}
+
+void tl_release_handler(TaskListHandler* hdl)
+{
+	int i;
+
+	if (!hdl)
+		return;
+	if (hdl->shards) {
+		for (i = 0; i < hdl->shardCount; i++) {
+			tl_release_handler(hdl->shards[i]);
+		}
+		free(hdl->shards);
+		hdl->shards = NULL;
+	}
+	tl_stop_task_loop_thread(hdl);
+	release_poll(hdl);
+	release_workers(hdl);
+	release_all_task(hdl);
+	pthread_mutex_destroy(&hdl->listLock);
+	pthread_cond_destroy(&hdl->listCond);
+	pthread_cond_destroy(&hdl->doneCond);
+	free(hdl->wheel);
+	free(hdl->stats);
+	free(hdl);
+}
+
+/*
+	Return 1 for empty, else 0
+*/
+int tl_is_empty(TaskListHandler* hdl)
+{
+	int i;
+
+	for (i = 0; i < hdl->shardCount; i++) {
+		if (!tl_is_empty(hdl->shards[i])) {
+			return 0;
+		}
+	}
+	return (hdl->taskCount == 0 && !__atomic_load_n(&hdl->inbox, __ATOMIC_SEQ_CST))? 1: 0;
+}
+
+
+/*
+	the main thread that will handle task in list
+*/
+void* tl_task_loop(void *param)
+{
+	struct timespec ts;
+	int ret;
+	TaskListHandler* hdl = (TaskListHandler*) param;
+
+	if (!hdl) return NULL;
+	
+	while (hdl->isRunning) {
+		lock_task_list(hdl);
+		get_next_timeout_time(hdl, &ts);
+		// producer pushes task then reads waitTime, loop publishes waitTime then
+		// reads inbox, so a task added meanwhile is either seen here or signaled
+		if (__atomic_load_n(&hdl->inbox, __ATOMIC_SEQ_CST)) {
+			pthread_mutex_unlock(&hdl->listLock);
+			continue;
+		}
+		//LOGI("loop waiting, tv_sec=%ld, tv_nsec=%ld..............................", ts.tv_sec, ts.tv_nsec);
+		ret = pthread_cond_timedwait(&hdl->listCond, &hdl->listLock, &ts);
+		__atomic_add_fetch(&hdl->wakeupCount, 1, __ATOMIC_RELAXED);
+		if (ret == ETIMEDOUT) {
+			do_task(hdl);
+		}
+		// else change notify
+		pthread_mutex_unlock(&hdl->listLock);
+	}
+
+	return NULL;
+}
+
+/*
+	create thread that will call tl_task_loop() without block current thread 
+*/
+int tl_start_task_loop_thread(TaskListHandler* hdl)
+{
+	int i;
+
+	if (hdl->shards) {
+		for (i = 0; i < hdl->shardCount; i++) {
+			if (tl_start_task_loop_thread(hdl->shards[i]) != 0) {
+				return -1;
+			}
+		}
+		hdl->isRunning = 1;
+		return 0;
+	}
+
+	if (hdl->poll) {
+		LOGE("tl_start_task_loop_thread: handler is in poll mode");
+		return -1;
+	}
+	LOGD("Start task loop thread");
+	if (hdl->workers && start_workers(hdl) != 0) {
+		LOGE("tl_start_task_loop_thread: start workers fail");
+		return -1;
+	}
+	hdl->isRunning = 1;
+	pthread_create(&hdl->loopThread, NULL, tl_task_loop, hdl);
+	return 0;
+}
+
+/*
+	stop thread create by tl_start_task_loop_thread()
+*/
+int tl_stop_task_loop_thread(TaskListHandler* hdl)
+{
+	int i;
+
+	if (hdl->shards) {
+		for (i = 0; i < hdl->shardCount; i++) {
+			tl_stop_task_loop_thread(hdl->shards[i]);
+		}
+		hdl->isRunning = 0;
+		return 0;
+	}
+	if (hdl->isRunning == 0 || hdl->loopThread == 0)
+		return 0;
+
+	LOGD("Stop task loop thread...");
+	pthread_mutex_lock(&hdl->listLock);
+	hdl->isRunning = 0;
+	pthread_cond_signal(&hdl->listCond); // trigger interrupt to end
+	pthread_mutex_unlock(&hdl->listLock);
+	pthread_join(hdl->loopThread, NULL);
+	if (hdl->workers) {
+		stop_workers(hdl);
+	}
+	wait_executor(hdl);
+	LOGD("Stop task loop thread...ok");
+	hdl->loopThread = 0;
+	return 0;
+}
+
+/*
+	Switch to poll mode, caller's event loop calls tl_process_expired()
+	while returned fd is readable
+	Return fd for success, -1 for fail
+*/
+int tl_get_poll_fd(TaskListHandler* hdl)
+{
+#ifdef __linux__
+	struct TLPollST* poll;
+	struct timespec ts;
+
+	if (hdl->poll) {
+		return hdl->poll->epollFd;
+	}
+	if (hdl->shards || hdl->isRunning) {
+		LOGE("tl_get_poll_fd: not supported for sharded handler or running loop thread");
+		return -1;
+	}
+	poll = open_poll();
+	if (!poll) {
+		LOGE("tl_get_poll_fd: create fd fail, errno=%d", errno);
+		return -1;
+	}
+	if (hdl->workers && start_workers(hdl) != 0) {
+		LOGE("tl_get_poll_fd: start workers fail");
+		close_poll(poll);
+		return -1;
+	}
+
+	lock_task_list(hdl);
+	hdl->poll = poll;
+	arm_poll(poll, get_next_timeout_time(hdl, &ts));
+	pthread_mutex_unlock(&hdl->listLock);
+	return poll->epollFd;
+#else
+	LOGE("tl_get_poll_fd: not supported");
+	return -1;
+#endif
+}
+
+/*
+	Run due tasks and re-arm timer of poll mode, does the same as one round
+	of tl_task_loop() without waiting
+	Return 0 for success, -1 for fail
+*/
+int tl_process_expired(TaskListHandler* hdl)
+{
+#ifdef __linux__
+	struct timespec ts;
+	int64_t abstime;
+
+	if (!hdl->poll) {
+		return -1;
+	}
+	// clear fds first, a change after this makes fd readable again
+	clear_poll(hdl->poll);
+	__atomic_add_fetch(&hdl->wakeupCount, 1, __ATOMIC_RELAXED);
+
+	lock_task_list(hdl);
+	do {
+		do_task(hdl);
+		abstime = get_next_timeout_time(hdl, &ts);
+		// same as tl_task_loop(), a task added before waitTime is published
+		// may not notify, it is in inbox now
+	} while (__atomic_load_n(&hdl->inbox, __ATOMIC_SEQ_CST));
+	arm_poll(hdl->poll, abstime);
+	pthread_mutex_unlock(&hdl->listLock);
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/*
+	Run timeout tasks in worker threads
+	Return 0 for success, -1 for fail
+*/
+int tl_set_worker_threads(TaskListHandler* hdl, int workerCount, const int* cpus, int cpuCount)
+{
+	struct TLWorkersST* workers;
+	int i;
+
+	if (hdl->isRunning || hdl->poll) {
+		LOGE("tl_set_worker_threads: task loop is running");
+		return -1;
+	}
+	if (hdl->executor && workerCount > 0) {
+		LOGE("tl_set_worker_threads: executor is set");
+		return -1;
+	}
+	if (hdl->shards) {
+		for (i = 0; i < hdl->shardCount; i++) {
+			if (tl_set_worker_threads(hdl->shards[i], workerCount, cpus, cpuCount) != 0) {
+				return -1;
+			}
+		}
+		return 0;
+	}
+	release_workers(hdl);
+	if (workerCount <= 0) {
+		return 0;
+	}
+
+	workers = (struct TLWorkersST*) calloc(1, sizeof(struct TLWorkersST));
+	if (!workers) {
+		return -1;
+	}
+	workers->count = workerCount;
+	workers->threads = (pthread_t*) calloc(workerCount, sizeof(pthread_t));
+	if (cpus && cpuCount > 0) {
+		workers->cpus = (int*) malloc(cpuCount * sizeof(int));
+		if (workers->cpus) {
+			memcpy(workers->cpus, cpus, cpuCount * sizeof(int));
+			workers->cpuCount = cpuCount;
+		}
+	}
+	if (!workers->threads || (cpus && cpuCount > 0 && !workers->cpus)) {
+		free(workers->threads);
+		free(workers->cpus);
+		free(workers);
+		return -1;
+	}
+	hdl->workers = workers;
+	return 0;
+}
+
+int tl_set_executor(TaskListHandler* hdl, struct EXExecutorST* exec)
+{
+	int i;
+
+	if (hdl->isRunning || hdl->poll) {
+		LOGE("tl_set_executor: task loop is running");
+		return -1;
+	}
+	if (hdl->workers && exec) {
+		LOGE("tl_set_executor: worker threads are set");
+		return -1;
+	}
+	for (i = 0; i < hdl->shardCount; i++) {
+		if (tl_set_executor(hdl->shards[i], exec) != 0) {
+			return -1;
+		}
+	}
+	hdl->executor = exec;
+	return 0;
+}
+
+int tl_set_timer_slack(TaskListHandler* hdl, int64_t slack)
+{
+	int i;
+
+	if (slack < 0) {
+		return -1;
+	}
+	for (i = 0; i < hdl->shardCount; i++) {
+		tl_set_timer_slack(hdl->shards[i], slack);
+	}
+	pthread_mutex_lock(&hdl->listLock);
+	__atomic_store_n(&hdl->slack, slack, __ATOMIC_RELAXED);
+	notify_loop(hdl); // trigger interrupt to re-calculate timeout time
+	pthread_mutex_unlock(&hdl->listLock);
+	return 0;
+}
+
+int tl_set_run_budget(TaskListHandler* hdl, int maxTasks, int64_t maxTime)
+{
+	int i;
+
+	if (maxTasks < 0 || maxTime < 0) {
+		return -1;
+	}
+	for (i = 0; i < hdl->shardCount; i++) {
+		tl_set_run_budget(hdl->shards[i], maxTasks, maxTime);
+	}
+	pthread_mutex_lock(&hdl->listLock);
+	hdl->budgetTasks = maxTasks;
+	hdl->budgetTime = maxTime;
+	pthread_mutex_unlock(&hdl->listLock);
+	return 0;
+}
+
+uint64_t tl_get_wakeup_count(TaskListHandler* hdl)
+{
+	uint64_t count = __atomic_load_n(&hdl->wakeupCount, __ATOMIC_RELAXED);
+	int i;
+
+	for (i = 0; i < hdl->shardCount; i++) {
+		count += tl_get_wakeup_count(hdl->shards[i]);
+	}
+	return count;
+}
+
+int tl_enable_stats(TaskListHandler* hdl)
+{
+	struct TLStatsST* stats;
+	int i;
+
+	for (i = 0; i < hdl->shardCount; i++) {
+		if (tl_enable_stats(hdl->shards[i]) != 0) {
+			return -1;
+		}
+	}
+	if (hdl->stats) {
+		return 0;
+	}
+	stats = (struct TLStatsST*) calloc(1, sizeof(struct TLStatsST));
+	if (!stats) {
+		LOGE("tl_enable_stats: stats == NULL");
+		return -1;
+	}
+	stats->startTime = get_current_us_time();
+	hdl->stats = stats;
+	return 0;
+}
+
+int tl_get_stats(TaskListHandler* hdl, TLStats* stats)
+{
+	struct TLStatsSlotST* slot;
+	TLStats shardStats;
+	int i, j;
+
+	memset(stats, 0, sizeof(TLStats));
+	if (hdl->shards) {
+		for (i = 0; i < hdl->shardCount; i++) {
+			if (tl_get_stats(hdl->shards[i], &shardStats) != 0) {
+				return -1;
+			}
+			if (shardStats.elapsed > stats->elapsed) {
+				stats->elapsed = shardStats.elapsed;
+			}
+			stats->adds += shardStats.adds;
+			stats->cancels += shardStats.cancels;
+			stats->fires += shardStats.fires;
+			stats->lockCount += shardStats.lockCount;
+			stats->lockContended += shardStats.lockContended;
+			stats->taskCount += shardStats.taskCount;
+			stats->maxTaskCount += shardStats.maxTaskCount;
+			for (j = 0; j < TL_STATS_BUCKETS; j++) {
+				stats->lateness[j] += shardStats.lateness[j];
+				stats->execTime[j] += shardStats.execTime[j];
+			}
+		}
+		return 0;
+	}
+	if (!hdl->stats) {
+		return -1;
+	}
+
+	// counters are read without lock, they may be a little behind
+	stats->elapsed = get_current_us_time() - hdl->stats->startTime;
+	for (i = 0; i < TL_STATS_SLOTS; i++) {
+		slot = &hdl->stats->slots[i];
+		stats->adds += __atomic_load_n(&slot->adds, __ATOMIC_RELAXED);
+		stats->cancels += __atomic_load_n(&slot->cancels, __ATOMIC_RELAXED);
+		stats->fires += __atomic_load_n(&slot->fires, __ATOMIC_RELAXED);
+		stats->lockCount += __atomic_load_n(&slot->lockCount, __ATOMIC_RELAXED);
+		stats->lockContended += __atomic_load_n(&slot->lockContended, __ATOMIC_RELAXED);
+		for (j = 0; j < TL_STATS_BUCKETS; j++) {
+			stats->lateness[j] += __atomic_load_n(&slot->lateness[j], __ATOMIC_RELAXED);
+			stats->execTime[j] += __atomic_load_n(&slot->execTime[j], __ATOMIC_RELAXED);
+		}
+	}
+	pthread_mutex_lock(&hdl->listLock);
+	stats->taskCount = hdl->taskCount;
+	stats->maxTaskCount = hdl->stats->maxTaskCount;
+	pthread_mutex_unlock(&hdl->listLock);
+	return 0;
+}
+
+int tl_reserve_tasks(TaskListHandler* hdl, int count)
+{
+	int ret;
+	int i;
+
+	if (count <= 0) {
+		return 0;
+	}
+	if (hdl->shards) {
+		count = (count + hdl->shardCount - 1) / hdl->shardCount;
+		for (i = 0; i < hdl->shardCount; i++) {
+			if (tl_reserve_tasks(hdl->shards[i], count) != 0) {
+				return -1;
+			}
+		}
+		return 0;
+	}
+
+	ret = mempool_reserve(hdl->taskPool, count);
+	if (ret == 0 && hdl->type == TL_TYPE_HEAP) {
+		pthread_mutex_lock(&hdl->listLock);
+		ret = heap_reserve(hdl, count);
+		pthread_mutex_unlock(&hdl->listLock);
+	}
+	if (ret != 0) {
+		LOGE("tl_reserve_tasks: out of memory");
+	}
+	return ret;
+}
+
+/*
+	Add a new task to task list
+*/
+int tl_add_task_abstime_ex(TaskListHandler* hdl,
+			    int64_t abstime, // msec. time to invoke the callback function
+			    TLTaskFunc taskFunc, // callback function
+			    void* taskdata, // data for func
+			    TLTaskId* taskId)
+{
+	return add_task(hdl, abstime_to_clock_time(abstime), 0, taskFunc, taskdata, taskId);
+}
+
+int tl_add_task_abstime(TaskListHandler* hdl,
+			    int64_t abstime, // msec. time to invoke the callback function
+			    TLTaskFunc taskFunc, // callback function
+			    void* taskdata) // data for func
+{
+	return tl_add_task_abstime_ex(hdl, abstime, taskFunc, taskdata, NULL);
+}
+
+/*
+	Add a new task to task list
 */
-static void get_next_timeout_time(TaskListHandler* hdl, struct timespec* ts)
+int tl_add_task_ex(TaskListHandler* hdl,
+			    int64_t timeout, // msec. relative time to invoke the callback function
+			    TLTaskFunc taskFunc, // timeout callback function
+			    void* taskdata, // data for func
+			    TLTaskId* taskId)
 {
-	int64_t current = get_current_ms_time();
-	int64_t abstime;
-
-	ts->tv_sec = 2100000000; // 2036 year
-	ts->tv_nsec = 0;
-	if (!hdl->minTask) {
-		return;
-	}
-	abstime = hdl->minTask->abstime;
-	if (abstime <= current) {
-		ts->tv_sec = 0;
-		ts->tv_nsec = 0;
-	} else {
-		ts->tv_sec = abstime / 1000;
-		ts->tv_nsec = (abstime % 1000) * 1000000;
-	}
+	return add_task(hdl, get_current_us_time() + timeout * 1000, 0, taskFunc, taskdata, taskId);
 }
 
-static int dump_task(TLTask* task, void* dumpdata)
+int tl_add_task(TaskListHandler* hdl,
+			    int64_t timeout, // msec. relative time to invoke the callback function
+			    TLTaskFunc taskFunc, // timeout callback function
+			    void* taskdata) // data for func
 {
-	struct TASK_DUMP_ST* dumpst = (struct TASK_DUMP_ST*) dumpdata;
-	char* str = NULL;
-	struct tm timeinfo;
-	time_t rawtime = (time_t) task->abstime / 1000;
-
-	localtime_r(&rawtime, &timeinfo);
-
-	dumpst->count++;
-	LOGI("TASK %d(%p): abstime=%" PRId64 "(%04d-%02d-%02d %02d:%02d:%02d %d), taskFunc=%p",
-			dumpst->count, task, task->abstime,
-			timeinfo.tm_year+1900, timeinfo.tm_mon+1, timeinfo.tm_mday,
-			timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec,
-			timeinfo.tm_wday,
-			task->taskFunc);
-
-	if (dumpst->dumpFunc) {
-		dumpst->strBuf[sizeof(dumpst->strBuf)-1] = '\0'; // null end of strBuf
-		str = dumpst->dumpFunc(task->taskdata, dumpst->strBuf, sizeof(dumpst->strBuf)-1); // -1 to avoid null end be overwrite
-		if (str) {
-			LOGI("\tData in Task: %s", str);
-		}
-	}
-
-	return 0;
+	return tl_add_task_ex(hdl, timeout, taskFunc, taskdata, NULL);
 }
 
-static void release_all_task(TaskListHandler* hdl)
+/*
+	Add a new task to task list in usec
+*/
+int tl_add_task_us_ex(TaskListHandler* hdl,
+			    int64_t timeout, // usec. relative time to invoke the callback function
+			    TLTaskFunc taskFunc, // timeout callback function
+			    void* taskdata, // data for func
+			    TLTaskId* taskId)
 {
-	TLTask *task2free, *task;
+	return add_task(hdl, get_current_us_time() + timeout, 0, taskFunc, taskdata, taskId);
+}
 
-	pthread_mutex_lock(&hdl->listLock);
-	task = hdl->tasklist;
-	while (task) {
-		task2free = task;
-		task = task->next;
-		free(task2free);
-	}
-	hdl->tasklist = NULL;
-	pthread_mutex_unlock(&hdl->listLock);
+int tl_add_task_us(TaskListHandler* hdl,
+			    int64_t timeout, // usec. relative time to invoke the callback function
+			    TLTaskFunc taskFunc, // timeout callback function
+			    void* taskdata) // data for func
+{
+	return tl_add_task_us_ex(hdl, timeout, taskFunc, taskdata, NULL);
 }
 
 /*
-	do function for each task in taslist
+	Add n tasks at once, all of them are pushed to inbox by one atomic
+	operation and loop is waked up at most once
 */
-static int iterator_task(TaskListHandler* hdl, TLIteratorTaskFunc itfunc, void* itdata)
+int tl_add_tasks_batch(TaskListHandler* hdl, const TLTaskSpec* specs, int n, TLTaskId* taskIds)
 {
-	int ret = 0;
-	TLTask *task;
+	TLTask* first = NULL;
+	TLTask* last = NULL;
+	TLTask* task;
+	int64_t offset; // TL_CLOCK - wall clock, converted once for all tasks
+	int64_t minTime = INT64_MAX;
+	TLTaskId lastId = 0;
+	int i;
 
-	if (!itfunc) {
-		return -1;
+	if (n <= 0) {
+		return 0;
 	}
-	
-	pthread_mutex_lock(&hdl->listLock);
-	task = hdl->tasklist;
-	while (task) {
-		ret = itfunc(task, itdata);
-		if (ret == TL_IT_BREAK) {
-			break;
+	if (hdl->shards) {
+		return tl_add_tasks_batch(select_shard(hdl), specs, n, taskIds);
+	}
+
+	offset = get_current_us_time() - get_wall_us_time();
+	for (i = 0; i < n; i++) {
+		task = (TLTask*) mempool_alloc(hdl->taskPool);
+		if (!task) {
+			LOGE("tl_add_tasks_batch: task == NULL");
+			while (first) {
+				task = first;
+				first = first->next;
+				mempool_free(hdl->taskPool, task);
+			}
+			return -1;
+		}
+		task->abstime = specs[i].abstime * 1000 + offset;
+		task->taskFunc = specs[i].taskFunc;
+		task->taskdata = specs[i].taskdata;
+		task->queueIndex = -1;
+		task->next = first;
+		first = task;
+		if (!last) {
+			last = task;
+		}
+		if (task->abstime < minTime) {
+			minTime = task->abstime;
 		}
-		task = task->next;
 	}
-	pthread_mutex_unlock(&hdl->listLock);
-	return ret;
+
+	if (taskIds) {
+		// one range of ids for the whole batch, chain is in reverse order
+		lastId = __atomic_add_fetch(&hdl->lastTaskId, n, __ATOMIC_RELAXED);
+		for (task = first, i = n - 1; task; task = task->next, i--) {
+			task->taskId = ((lastId - (n - 1 - i)) << TL_SHARD_BITS) | hdl->shardIndex;
+			taskIds[i] = task->taskId;
+		}
+	}
+
+	stats_count_add(hdl, n);
+	inbox_push(hdl, first, last);
+	wakeup_loop(hdl, minTime);
+	return 0;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-// Task List Export Function
-////////////////////////////////////////////////////////////////////////////////
 /*
-	return NULL for fail
+	Add a task invoked every period, the task is re-armed after each run
 */
-TaskListHandler* tl_create_handler()
+int tl_add_periodic_task_ex(TaskListHandler* hdl,
+			    int64_t abstime, // msec from 1970. time of the first run
+			    int64_t period, // msec. interval between runs
+			    TLTaskFunc taskFunc, // callback function
+			    void* taskdata, // data for func
+			    TLTaskId* taskId)
 {
-	TaskListHandler* hdl = (TaskListHandler*) malloc(sizeof(TaskListHandler));
-	if (!hdl)
-		return NULL;
-	
-	memset(hdl, 0, sizeof(TaskListHandler));
-	pthread_mutex_init(&hdl->listLock, NULL);
-	pthread_cond_init(&hdl->listCond, NULL);
-
-	return hdl;
+	if (period <= 0) {
+		LOGE("tl_add_periodic_task: invalid period %" PRId64, period);
+		return -1;
+	}
+	return add_task(hdl, abstime_to_clock_time(abstime), period * 1000, taskFunc, taskdata, taskId);
 }
 
-void tl_release_handler(TaskListHandler* hdl)
+int tl_add_periodic_task(TaskListHandler* hdl,
+			    int64_t abstime, // msec from 1970. time of the first run
+			    int64_t period, // msec. interval between runs
+			    TLTaskFunc taskFunc, // callback function
+			    void* taskdata) // data for func
 {
-	if (!hdl)
-		return;
-	tl_stop_task_loop_thread(hdl);
-	release_all_task(hdl);
-	pthread_mutex_destroy(&hdl->listLock);
-	pthread_cond_destroy(&hdl->listCond);
-	free(hdl);
+	return tl_add_periodic_task_ex(hdl, abstime, period, taskFunc, taskdata, NULL);
 }
 
-/*
-	Return 1 for empty, else 0
-*/
-int tl_is_empty(TaskListHandler* hdl)
+int64_t tl_get_task_overrun(void)
 {
-	return (hdl->tasklist == NULL)? 1: 0;
+	return taskOverrun;
 }
 
-
 /*
-	the main thread that will handle task in list
+	Cancel task by id, wait for running callback if wait is set
+	Return 0 for success, -1 while task is not found or callback of
+	one-shot task has started
 */
-void* tl_task_loop(void *param)
+static int cancel_task(TaskListHandler* hdl, TLTaskId taskId, int wait)
 {
-	struct timespec ts;
-	int ret;
-	TaskListHandler* hdl = (TaskListHandler*) param;
+	TLTask *task = NULL;
+	int state = TL_TASK_PENDING;
+	int ret = -1;
 
-	if (!hdl) return NULL;
-	
-	while (hdl->isRunning) {
-		pthread_mutex_lock(&hdl->listLock);
-		get_next_timeout_time(hdl, &ts);
-		//LOGI("loop waiting, tv_sec=%ld, tv_nsec=%ld..............................", ts.tv_sec, ts.tv_nsec);
-		ret = pthread_cond_timedwait(&hdl->listCond, &hdl->listLock, &ts);
-		if (ret == ETIMEDOUT) {
-			do_task(hdl);
+	if (hdl->shards) {
+		hdl = shard_of_task_id(hdl, taskId);
+		if (!hdl) {
+			return -1;
 		}
-		// else change notify
+	}
+
+	lock_task_list(hdl);
+	if (hdl->taskIds) {
+		task = (TLTask*) idmap_get(hdl->taskIds, taskId);
+	}
+	if (!task) {
+		pthread_mutex_unlock(&hdl->listLock);
+		return -1;
+	}
+	if (task->queueIndex >= 0) {
+		remove_task(hdl, task);
 		pthread_mutex_unlock(&hdl->listLock);
+		mempool_free(hdl->taskPool, task);
+		stats_count_cancel(hdl);
+		return 0;
 	}
 
-	return NULL;
+	// not in queue, it is in run list, running or being re-armed
+	if (__atomic_compare_exchange_n(&task->state, &state, TL_TASK_CANCELLED, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		// callback doesn't start, run_task(), drain_inbox() or do_task() frees it
+		untrack_task(hdl, task);
+		pthread_mutex_unlock(&hdl->listLock);
+		stats_count_cancel(hdl);
+		return 0;
+	}
+	if (state == TL_TASK_RUNNING && task->period > 0) {
+		// not re-armed after callback returns
+		__atomic_store_n(&task->state, TL_TASK_CANCELLED, __ATOMIC_RELEASE);
+		stats_count_cancel(hdl);
+		ret = 0;
+	}
+	if (wait && task != currentTask) {
+		// run_task() untracks it when callback returns
+		hdl->syncWaiters++;
+		while (idmap_get(hdl->taskIds, taskId) == task) {
+			pthread_cond_wait(&hdl->doneCond, &hdl->listLock);
+		}
+		hdl->syncWaiters--;
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+	return ret;
 }
 
 /*
-	create thread that will call tl_task_loop() without block current thread 
+	Remove task by id
+	Return 0 for success, -1 while task is not found
 */
-int tl_start_task_loop_thread(TaskListHandler* hdl)
+int tl_cancel_task(TaskListHandler* hdl, TLTaskId taskId)
 {
-	LOGD("Start task loop thread");
-	hdl->isRunning = 1;
-	pthread_create(&hdl->loopThread, NULL, tl_task_loop, hdl);
-	return 0;
+	return cancel_task(hdl, taskId, 0);
 }
 
 /*
-	stop thread create by tl_start_task_loop_thread()
+	Remove task by id, and wait until its callback is not running
+	Return 0 for success, -1 while task is not found
 */
-int tl_stop_task_loop_thread(TaskListHandler* hdl)
+int tl_cancel_task_sync(TaskListHandler* hdl, TLTaskId taskId)
 {
-	if (hdl->isRunning == 0 || hdl->loopThread == 0)
-		return 0;
-
-	LOGD("Stop task loop thread...");
-	pthread_mutex_lock(&hdl->listLock);
-	hdl->isRunning = 0;
-	pthread_cond_signal(&hdl->listCond); // trigger interrupt to end
-	pthread_mutex_unlock(&hdl->listLock);
-	pthread_join(hdl->loopThread, NULL);
-	LOGD("Stop task loop thread...ok");
-	hdl->loopThread = 0;
-	return 0;
+	return cancel_task(hdl, taskId, 1);
 }
 
 /*
-	Add a new task to task list
+	Return TL_TASK_PENDING, TL_TASK_RUNNING or TL_TASK_DONE
 */
-int tl_add_task_abstime(TaskListHandler* hdl,
-			    int64_t abstime, // msec. time to invoke the callback function
-			    TLTaskFunc taskFunc, // callback function
-			    void* taskdata) // data for func
+int tl_get_task_state(TaskListHandler* hdl, TLTaskId taskId)
 {
-	TLTask *task = (TLTask*) calloc(1, sizeof(TLTask));
-	if (!task) {
-		LOGE("tl_add_task: task == NULL");
-		return -1;
-	}
+	TLTask *task = NULL;
+	int state = TL_TASK_DONE;
 
-	// init task
-	task->abstime = abstime;
-	task->taskFunc = taskFunc;
-	task->taskdata = taskdata;
+	if (hdl->shards) {
+		hdl = shard_of_task_id(hdl, taskId);
+		if (!hdl) {
+			return TL_TASK_DONE;
+		}
+	}
 
-	// add to list
-	pthread_mutex_lock(&hdl->listLock);
-	if (hdl->tasklist) {
-		task->next = hdl->tasklist;
-	} else {
-		task->next = NULL;
+	lock_task_list(hdl);
+	if (hdl->taskIds) {
+		task = (TLTask*) idmap_get(hdl->taskIds, taskId);
 	}
-	hdl->tasklist = task;
-	
-	// update minTask
-	if (hdl->minTask) {
-		if (task->abstime < hdl->minTask->abstime) {
-			hdl->minTask = task;
+	if (task) {
+		// cancelled task is still tracked only while its callback is running
+		state = __atomic_load_n(&task->state, __ATOMIC_ACQUIRE);
+		if (task->queueIndex >= 0 || state == TL_TASK_PENDING) {
+			state = TL_TASK_PENDING;
+		} else {
+			state = TL_TASK_RUNNING;
 		}
-	} else {
-		hdl->minTask = task;
 	}
-	// trigger interrupt to re-calculate timeout time
-	pthread_cond_signal(&hdl->listCond);
 	pthread_mutex_unlock(&hdl->listLock);
-
-	return 0;
+	return state;
 }
 
 /*
-	Add a new task to task list
+	Change abstime of task by id
+	Return 0 for success, -1 while task is not found
 */
-int tl_add_task(TaskListHandler* hdl,
-			    int64_t timeout, // msec. relative time to invoke the callback function
-			    TLTaskFunc taskFunc, // timeout callback function
-			    void* taskdata) // data for func
+int tl_reschedule_task(TaskListHandler* hdl, TLTaskId taskId, int64_t abstime)
 {
-	return tl_add_task_abstime(hdl,
-							   timeout + (time(NULL) * 1000),
-							   taskFunc,
-							   taskdata);
+	TLTask *task = NULL;
+	int isMinTask;
+
+	if (hdl->shards) {
+		hdl = shard_of_task_id(hdl, taskId);
+		if (!hdl) {
+			return -1;
+		}
+	}
+
+	lock_task_list(hdl);
+	if (hdl->taskIds) {
+		task = (TLTask*) idmap_get(hdl->taskIds, taskId);
+	}
+	if (!task || task->queueIndex < 0) { // not found or periodic task is running
+		pthread_mutex_unlock(&hdl->listLock);
+		return -1;
+	}
+	isMinTask = (hdl->minTask == task);
+	// queue_insert() never fail after queue_remove(), the space is reserved
+	queue_remove(hdl, task);
+	task->abstime = abstime_to_clock_time(abstime);
+	queue_insert(hdl, task);
+	if (isMinTask || task->abstime + hdl->slack < __atomic_load_n(&hdl->waitTime, __ATOMIC_SEQ_CST)) {
+		notify_loop(hdl); // trigger interrupt to re-calculate timeout time
+	}
+	pthread_mutex_unlock(&hdl->listLock);
+	return 0;
 }
 
 /*
@@ -361,53 +2410,56 @@ int tl_add_task(TaskListHandler* hdl,
 */
 int tl_iterator_task(TaskListHandler* hdl, TLIteratorFunc itfunc, void* itdata)
 {
+	struct TASK_ITERATOR_ST itst;
+	int i;
 	int ret = 0;
-	TLTask *task = NULL;
-	TLTask *lastTask = NULL;
-	TLTask *task2free = NULL;
 
 	if (!itfunc) {
 		return -1;
 	}
-
-	pthread_mutex_lock(&hdl->listLock);
-	task = hdl->tasklist;
-	while (task) {
-		ret = itfunc(hdl, task->taskdata, itdata);
-		if (ret == TL_IT_BREAK) {
-			break;
-		} else if (ret == TL_IT_REMOVE || ret == TL_IT_REMOVE_BREAK) {
-			// remove task from list
-			if (hdl->tasklist == task) { // first task
-				hdl->tasklist = task->next;
-			}
-			if (lastTask) {
-				lastTask->next = task->next;
-			}
-			task2free = task;
-			task = task->next;
-			// check minTask
-			if (hdl->minTask == task2free) {
-				update_min_task(hdl);
-				pthread_cond_signal(&hdl->listCond); // trigger interrupt to re-calculate timeout time
-			}
-			// free task
-			free(task2free);
-			
-			// break or not
-			if (ret == TL_IT_REMOVE_BREAK) {
+	if (hdl->shards) {
+		for (i = 0; i < hdl->shardCount; i++) {
+			ret = tl_iterator_task(hdl->shards[i], itfunc, itdata);
+			if (ret == TL_IT_BREAK || ret == TL_IT_REMOVE_BREAK) {
 				break;
-			} else {
-				continue;
 			}
-		} else {
-			// get next task
-			lastTask = task;
-			task = task->next;
 		}
+		return ret;
+	}
+
+	memset(&itst, 0, sizeof(itst));
+	itst.hdl = hdl;
+	itst.itfunc = itfunc;
+	itst.itdata = itdata;
+
+	lock_task_list(hdl);
+	queue_foreach(hdl, iterator_user_task, &itst);
+	// removing from queue will reorder it, so remove after iteration
+	for (i = 0; i < itst.removeCount; i++) {
+		remove_task(hdl, itst.removeTasks[i]);
+		mempool_free(hdl->taskPool, itst.removeTasks[i]);
 	}
 	pthread_mutex_unlock(&hdl->listLock);
-	return ret;
+	free(itst.removeTasks);
+	return itst.ret;
+}
+
+/*
+	Do function, itfunc, for each task in a copy of taslist
+	listLock is only held while copying, so user callbacks don't stall the
+	loop and adding threads. itfunc() returns TL_IT_CONTINUE or TL_IT_BREAK,
+	tasks can't be removed.
+*/
+int tl_iterator_task_snapshot(TaskListHandler* hdl, TLIteratorFunc itfunc, void* itdata)
+{
+	struct TASK_USER_SNAPSHOT_ST userst;
+
+	if (!itfunc) {
+		return -1;
+	}
+	userst.itfunc = itfunc;
+	userst.itdata = itdata;
+	return iterator_snapshot(hdl, iterator_user_snapshot, &userst);
 }
 
 /*
@@ -422,7 +2474,7 @@ int tl_dump_tasks(char* title, TaskListHandler* hdl, TLDumpFunc dumpFunc)
 
 	dumpst.dumpFunc = dumpFunc;
 	dumpst.count = 0;
-	iterator_task(hdl, dump_task, &dumpst);
+	iterator_snapshot(hdl, dump_task, &dumpst);
 	
 	if (title) LOGI("------ %s LIST END ------", title);
 	else LOGI("------ DUMP TASK LIST END ------");
@@ -439,25 +2491,27 @@ int tl_dump_tasks(char* title, TaskListHandler* hdl, TLDumpFunc dumpFunc)
 */
 void* tl_find_task(TaskListHandler* hdl, TLMatchFunc matchFunc, void* matchdata)
 {
-	int ret = 0;
 	TLTask *task;
+	void *retdata = NULL;
+	int i;
 
 	if (!matchFunc) {
 		return NULL;
 	}
-	
-	pthread_mutex_lock(&hdl->listLock);
-	task = hdl->tasklist;
-	while (task) {
-		ret = matchFunc(task->taskdata, matchdata);
-		if (ret == TL_IT_MATCH) {
-			pthread_mutex_unlock(&hdl->listLock);
-			return task->taskdata;
+	if (hdl->shards) {
+		for (i = 0; i < hdl->shardCount && !retdata; i++) {
+			retdata = tl_find_task(hdl->shards[i], matchFunc, matchdata);
 		}
-		task = task->next;
+		return retdata;
+	}
+	
+	lock_task_list(hdl);
+	task = find_task(hdl, matchFunc, matchdata);
+	if (task) {
+		retdata = task->taskdata;
 	}
 	pthread_mutex_unlock(&hdl->listLock);
-	return NULL;
+	return retdata;
 }
 
 /*
@@ -468,40 +2522,29 @@ void* tl_find_task(TaskListHandler* hdl, TLMatchFunc matchFunc, void* matchdata)
 */
 void* tl_remove_task(TaskListHandler* hdl, TLMatchFunc matchFunc, void* matchdata)
 {
-	int ret = 0;
-	TLTask *task, *lastTask = NULL;
+	TLTask *task;
 	void *retdata = NULL;
+	int i;
 
 	if (!matchFunc) {
 		return NULL;
 	}
-	
-	pthread_mutex_lock(&hdl->listLock);
-	task = hdl->tasklist;
-	while (task) {
-		ret = matchFunc(task->taskdata, matchdata);
-		if (ret == TL_IT_MATCH) {
-			if (hdl->tasklist == task) { // first task
-				hdl->tasklist = task->next;
-			}
-			if (lastTask) {
-				lastTask->next = task->next;
-			}
-			retdata = task->taskdata;
-			// check minTask
-			if (hdl->minTask == task) {
-				update_min_task(hdl);
-				pthread_cond_signal(&hdl->listCond); // trigger interrupt to re-calculate timeout time
-			}
-			free(task); // free task item
-			pthread_mutex_unlock(&hdl->listLock);
-			return retdata;
+	if (hdl->shards) {
+		for (i = 0; i < hdl->shardCount && !retdata; i++) {
+			retdata = tl_remove_task(hdl->shards[i], matchFunc, matchdata);
 		}
-		lastTask = task;
-		task = task->next;
+		return retdata;
+	}
+	
+	lock_task_list(hdl);
+	task = find_task(hdl, matchFunc, matchdata);
+	if (task) {
+		retdata = task->taskdata;
+		remove_task(hdl, task);
+		mempool_free(hdl->taskPool, task); // free task item
 	}
 	pthread_mutex_unlock(&hdl->listLock);
-	return NULL;
+	return retdata;
 }
 
 /*
@@ -509,8 +2552,13 @@ void* tl_remove_task(TaskListHandler* hdl, TLMatchFunc matchFunc, void* matchdat
 */
 void tl_refresh_loop(TaskListHandler* hdl)
 {
+	int i;
+
+	for (i = 0; i < hdl->shardCount; i++) {
+		tl_refresh_loop(hdl->shards[i]);
+	}
 	pthread_mutex_lock(&hdl->listLock);
 	update_min_task(hdl);
-	pthread_cond_signal(&hdl->listCond); // trigger interrupt to re-calculate timeout time
+	notify_loop(hdl); // trigger interrupt to re-calculate timeout time
 	pthread_mutex_unlock(&hdl->listLock);
 }
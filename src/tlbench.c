@@ -0,0 +1,1180 @@
+/*
+    Benchmark suite for tasklist and listutil, built by "make bench"
+
+    Usage: tlbench [-t threads] [-n items] [-s suite]
+        -t  comma separated thread counts, default 1,4,16,64
+        -n  comma separated item counts, default 1000,10000,100000,1000000
+        -s  tasklist, listutil, executor or scheduler, default all
+
+    Results are printed to stdout as CSV:
+        suite,backend,threads,items,metric,value,unit
+    so runs can be compared by script. Random times use a fixed seed, so
+    each run schedules the same timers.
+*/
+#include "tasklist.h"
+#include "listutil.h"
+#include "executor.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+
+#define BENCH_MAX_VALUES        16
+#define BENCH_FAR_TIMEOUT       3600000 // msec, tasks never fire during insert/cancel
+#define BENCH_LATE_DELAY        100000 // usec, first timer of latency test
+#define BENCH_LATE_SPAN         1000000 // usec, timers of latency test spread over it
+#define BENCH_WALK_DELAY        1000 // usec, task due after a walk of all tasks starts
+#define BENCH_RING_CAPACITY     4096
+#define BENCH_FIND_LOOKUPS      1000 // lu_find() walks the list, limit lookups of unkeyed list
+#define BENCH_JOB_WORK          64 // rounds of xorshift in one job, about 100 nsec
+#define BENCH_RESERVE           1024 // tasks/entries reserved by churn test
+#define BENCH_SLACK_TIMERS      2000
+#define BENCH_SLACK_SPAN        2000 // msec, timers of slack test spread over it
+#define BENCH_BUDGET_TASKS      20000
+#define BENCH_BUDGET_SPAN       50 // msec, burst deadlines are spread over it
+#define BENCH_BUDGET_URGENT     20 // urgent tasks added while burst is running
+#define BENCH_BLOCK_TASKS       400 // every 10th task blocks 50 msec
+#define BENCH_RELEASE_LISTS     1000
+
+typedef struct {
+    const char* name;
+    int type; // TL_TYPE_xxx
+    int shards; // 0 for not sharded
+} TLBackend;
+
+typedef struct {
+    const char* name;
+    int type; // LU_TYPE_xxx
+    int isStack; // producer uses lu_push()
+    int isRing; // created by lu_create_ring()
+    int isSpsc; // only 1 producer and 1 consumer
+    int isPriority; // items are random priorities
+    int isKeyed; // created by lu_create_keyed_list(), single thread only
+} LUBackend;
+
+static const TLBackend tlBackends[] = {
+    { "heap", TL_TYPE_HEAP, 0 },
+    { "wheel", TL_TYPE_WHEEL, 0 },
+    { "sharded_heap", TL_TYPE_HEAP, 4 },
+};
+
+static const LUBackend luBackends[] = {
+    { "list", LU_TYPE_LIST, 0, 0, 0, 0, 0 },
+    { "nonblock_queue", LU_TYPE_NONBLOCK_QUEUE, 0, 0, 0, 0, 0 },
+    { "block_queue", LU_TYPE_BLOCK_QUEUE, 0, 0, 0, 0, 0 },
+    { "nonblock_stack", LU_TYPE_NONBLOCK_STACK, 1, 0, 0, 0, 0 },
+    { "block_stack", LU_TYPE_BLOCK_STACK, 1, 0, 0, 0, 0 },
+    { "ring_spsc", LU_TYPE_RING_SPSC, 0, 1, 1, 0, 0 },
+    { "block_ring_spsc", LU_TYPE_BLOCK_RING_SPSC, 0, 1, 1, 0, 0 },
+    { "ring_mpmc", LU_TYPE_RING_MPMC, 0, 1, 0, 0, 0 },
+    { "block_ring_mpmc", LU_TYPE_BLOCK_RING_MPMC, 0, 1, 0, 0, 0 },
+    { "priority", LU_TYPE_PRIORITY, 0, 0, 0, 1, 0 },
+    { "block_priority", LU_TYPE_BLOCK_PRIORITY, 0, 0, 0, 1, 0 },
+    { "keyed_list", LU_TYPE_LIST, 0, 0, 0, 0, 1 },
+    { "intrusive_queue", LU_TYPE_NONBLOCK_QUEUE | LU_TYPE_INTRUSIVE, 0, 0, 0, 0, 0 },
+};
+
+/*
+    arguments of one benchmark thread
+*/
+typedef struct {
+    TaskListHandler* tl;
+    LUHandler* lu;
+    const LUBackend* luBackend;
+    int index;
+    int count; // items of this thread
+    TLTaskId* taskIds;
+    int64_t* dues; // usec of monotonic clock, for latency test
+    int64_t startTime; // nsec, after all threads are ready
+    int64_t endTime; // nsec
+} BenchThread;
+
+static pthread_barrier_t benchBarrier;
+
+// filled by task_late(), indexed by lateCount
+static int64_t* lateValues;
+static int lateCount;
+static volatile int firedCount;
+static int fireTarget; // task_nop() records fireEnd when firedCount reaches it
+static int64_t fireEnd;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t now_us(void)
+{
+    return now_ns() / 1000;
+}
+
+/*
+    msec from 1970, for tl_add_task_abstime()
+*/
+static int64_t now_wall_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+    items per second, elapsed is nsec
+*/
+static double rate(int items, int64_t elapsed)
+{
+    return items * 1000000000.0 / (elapsed > 0? elapsed: 1);
+}
+
+/*
+    all threads wait here, so they start together
+*/
+static void thread_start(BenchThread* arg)
+{
+    pthread_barrier_wait(&benchBarrier);
+    arg->startTime = now_ns();
+}
+
+static void print_result(const char* suite, const char* backend, int threads, int items,
+                         const char* metric, double value, const char* unit)
+{
+    printf("%s,%s,%d,%d,%s,%.1f,%s\n", suite, backend, threads, items, metric, value, unit);
+    fflush(stdout);
+}
+
+/*
+    parse comma separated positive numbers into values
+    return number of values, 0 for invalid list
+*/
+static int parse_list(const char* str, int* values)
+{
+    int count = 0;
+    char* end;
+    long value;
+
+    while (*str && count < BENCH_MAX_VALUES) {
+        value = strtol(str, &end, 10);
+        if (end == str || value <= 0) {
+            return 0;
+        }
+        values[count++] = (int) value;
+        str = (*end == ',')? end + 1: end;
+    }
+    return count;
+}
+
+/*
+    nsec from the first thread started to the last thread done
+*/
+static int64_t threads_elapsed(BenchThread* args, int count)
+{
+    int64_t start = args[0].startTime;
+    int64_t end = args[0].endTime;
+    int i;
+
+    for (i = 1; i < count; i++) {
+        if (args[i].startTime < start) {
+            start = args[i].startTime;
+        }
+        if (args[i].endTime > end) {
+            end = args[i].endTime;
+        }
+    }
+    return end - start;
+}
+
+/*
+    start count threads running func, wait them done and return the nsec
+    from the first thread started to the last thread done
+*/
+static int64_t run_threads(void* (*func)(void*), BenchThread* args, int count)
+{
+    pthread_t* threads = (pthread_t*) malloc(count * sizeof(pthread_t));
+    int i;
+
+    pthread_barrier_init(&benchBarrier, NULL, count + 1);
+    for (i = 0; i < count; i++) {
+        pthread_create(&threads[i], NULL, func, &args[i]);
+    }
+    pthread_barrier_wait(&benchBarrier);
+    for (i = 0; i < count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&benchBarrier);
+    free(threads);
+    return threads_elapsed(args, count);
+}
+
+static int compare_int64(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*) a;
+    int64_t y = *(const int64_t*) b;
+    return (x > y) - (x < y);
+}
+
+//////////////////////////////////////////////////////////////
+// TaskListHandler benchmark
+//////////////////////////////////////////////////////////////
+static void* task_nop(TaskListHandler* hdl, void *data)
+{
+    if (__sync_add_and_fetch(&firedCount, 1) == fireTarget) {
+        fireEnd = now_ns();
+    }
+    return NULL;
+}
+
+/*
+    data:
+        due time of task, usec of monotonic clock
+*/
+static void* task_late(TaskListHandler* hdl, void *data)
+{
+    int64_t late = now_us() - *(int64_t*) data;
+
+    lateValues[__sync_fetch_and_add(&lateCount, 1)] = late;
+    __sync_fetch_and_add(&firedCount, 1);
+    return NULL;
+}
+
+static void* thread_insert(void* param)
+{
+    BenchThread* arg = (BenchThread*) param;
+    int i;
+
+    thread_start(arg);
+    for (i = 0; i < arg->count; i++) {
+        tl_add_task_ex(arg->tl, BENCH_FAR_TIMEOUT, task_nop, NULL, &arg->taskIds[i]);
+    }
+    arg->endTime = now_ns();
+    return NULL;
+}
+
+static void* thread_cancel(void* param)
+{
+    BenchThread* arg = (BenchThread*) param;
+    int i;
+
+    thread_start(arg);
+    for (i = 0; i < arg->count; i++) {
+        tl_cancel_task(arg->tl, arg->taskIds[i]);
+    }
+    arg->endTime = now_ns();
+    return NULL;
+}
+
+static void* thread_insert_due(void* param)
+{
+    BenchThread* arg = (BenchThread*) param;
+    int i;
+
+    thread_start(arg);
+    for (i = 0; i < arg->count; i++) {
+        tl_add_task_us(arg->tl, 0, task_nop, NULL);
+    }
+    arg->endTime = now_ns();
+    return NULL;
+}
+
+static void* thread_insert_late(void* param)
+{
+    BenchThread* arg = (BenchThread*) param;
+    unsigned int seed = arg->index + 1;
+    int64_t timeout;
+    int i;
+
+    thread_start(arg);
+    for (i = 0; i < arg->count; i++) {
+        timeout = BENCH_LATE_DELAY + rand_r(&seed) % BENCH_LATE_SPAN;
+        arg->dues[i] = now_us() + timeout;
+        tl_add_task_us(arg->tl, timeout, task_late, &arg->dues[i]);
+    }
+    arg->endTime = now_ns();
+    return NULL;
+}
+
+static TaskListHandler* create_tl(const TLBackend* backend)
+{
+    if (backend->shards) {
+        return tl_create_sharded_handler(backend->type, backend->shards);
+    }
+    return tl_create_handler_with_type(backend->type);
+}
+
+static void wait_fired(int count)
+{
+    while (firedCount < count) {
+        usleep(1000);
+    }
+}
+
+/*
+    formats one line per task, like tl_dump_tasks()
+*/
+static int walk_task(TaskListHandler* hdl, void* taskdata, void* itdata)
+{
+    char line[64];
+
+    snprintf(line, sizeof(line), "TASK %p", taskdata);
+    *(int*) itdata += line[0];
+    return TL_IT_CONTINUE;
+}
+
+/*
+    walk all tasks by tl_iterator_task() or tl_iterator_task_snapshot()
+    while a task is due BENCH_WALK_DELAY after the walk starts, return usec
+    the task is late, the loop can't fire it while the walk holds listLock
+*/
+static int64_t walk_stall(TaskListHandler* hdl, int snapshot)
+{
+    int64_t due, late = 0;
+    int sum = 0;
+
+    lateValues = &late;
+    lateCount = 0;
+    firedCount = 0;
+    due = now_us() + BENCH_WALK_DELAY;
+    tl_add_task_us(hdl, BENCH_WALK_DELAY, task_late, &due);
+    if (snapshot) {
+        tl_iterator_task_snapshot(hdl, walk_task, &sum);
+    } else {
+        tl_iterator_task(hdl, walk_task, &sum);
+    }
+    wait_fired(1);
+    lateValues = NULL;
+    return late;
+}
+
+/*
+    insert/cancel throughput with running loop, fire throughput of due
+    tasks, and fire lateness of timers spread over BENCH_LATE_SPAN
+*/
+static void bench_tasklist(const TLBackend* backend, int threads, int items)
+{
+    BenchThread* args = (BenchThread*) calloc(threads, sizeof(BenchThread));
+    TLTaskId* taskIds = (TLTaskId*) malloc(items * sizeof(TLTaskId));
+    int64_t* dues = (int64_t*) malloc(items * sizeof(int64_t));
+    TaskListHandler* hdl;
+    int64_t elapsed;
+    int i, offset = 0;
+
+    for (i = 0; i < threads; i++) {
+        args[i].index = i;
+        args[i].count = items / threads + (i < items % threads? 1: 0);
+        args[i].taskIds = taskIds + offset;
+        args[i].dues = dues + offset;
+        offset += args[i].count;
+    }
+
+    // insert and cancel
+    hdl = create_tl(backend);
+    tl_start_task_loop_thread(hdl);
+    for (i = 0; i < threads; i++) {
+        args[i].tl = hdl;
+    }
+    elapsed = run_threads(thread_insert, args, threads);
+    print_result("tasklist", backend->name, threads, items, "insert", rate(items, elapsed), "ops/s");
+    print_result("tasklist", backend->name, threads, items, "walk_stall", walk_stall(hdl, 0), "us");
+    print_result("tasklist", backend->name, threads, items, "walk_stall_snapshot", walk_stall(hdl, 1), "us");
+    elapsed = run_threads(thread_cancel, args, threads);
+    print_result("tasklist", backend->name, threads, items, "cancel", rate(items, elapsed), "ops/s");
+    tl_release_handler(hdl);
+
+    // fire, all tasks are due when loop starts
+    hdl = create_tl(backend);
+    for (i = 0; i < threads; i++) {
+        args[i].tl = hdl;
+    }
+    run_threads(thread_insert_due, args, threads);
+    firedCount = 0;
+    fireTarget = items;
+    elapsed = now_ns();
+    tl_start_task_loop_thread(hdl);
+    wait_fired(items);
+    elapsed = fireEnd - elapsed;
+    fireTarget = 0;
+    print_result("tasklist", backend->name, threads, items, "fire", rate(items, elapsed), "ops/s");
+    tl_release_handler(hdl);
+
+    // lateness
+    hdl = create_tl(backend);
+    tl_start_task_loop_thread(hdl);
+    for (i = 0; i < threads; i++) {
+        args[i].tl = hdl;
+    }
+    lateValues = (int64_t*) malloc(items * sizeof(int64_t));
+    lateCount = 0;
+    firedCount = 0;
+    run_threads(thread_insert_late, args, threads);
+    wait_fired(items);
+    qsort(lateValues, items, sizeof(int64_t), compare_int64);
+    print_result("tasklist", backend->name, threads, items, "late_p50", lateValues[items / 2], "us");
+    print_result("tasklist", backend->name, threads, items, "late_p99", lateValues[(int) (items * 0.99)], "us");
+    print_result("tasklist", backend->name, threads, items, "late_p999", lateValues[(int) (items * 0.999)], "us");
+    print_result("tasklist", backend->name, threads, items, "late_max", lateValues[items - 1], "us");
+    free(lateValues);
+    lateValues = NULL;
+    tl_release_handler(hdl);
+
+    free(dues);
+    free(taskIds);
+    free(args);
+}
+
+//////////////////////////////////////////////////////////////
+// LUHandler benchmark
+//////////////////////////////////////////////////////////////
+static void* thread_produce(void* param)
+{
+    BenchThread* arg = (BenchThread*) param;
+    void* item = (void*) (intptr_t) (arg->index + 1); // not NULL
+    unsigned int seed = arg->index + 1;
+    int i;
+
+    thread_start(arg);
+    for (i = 0; i < arg->count; i++) {
+        if (arg->luBackend->isPriority) {
+            item = (void*) (intptr_t) (rand_r(&seed) + 1);
+        }
+        while ((arg->luBackend->isStack? lu_push(arg->lu, item): lu_add(arg->lu, item)) != 0) {
+            sched_yield(); // ring is full
+        }
+    }
+    arg->endTime = now_ns();
+    return NULL;
+}
+
+static void* thread_consume(void* param)
+{
+    BenchThread* arg = (BenchThread*) param;
+    int count = 0;
+
+    thread_start(arg);
+    while (1) {
+        if (lu_pop(arg->lu)) {
+            count++;
+            continue;
+        }
+        // nonblock list or closed list is empty
+        if (lu_is_closed(arg->lu) && lu_is_empty(arg->lu)) {
+            break;
+        }
+        if (!(arg->luBackend->type & LU_TYPE_BLOCK)) {
+            sched_yield();
+        }
+    }
+    arg->count = count;
+    arg->endTime = now_ns();
+    return NULL;
+}
+
+static uint64_t item_key(void* entrydata)
+{
+    return (uint64_t) (intptr_t) entrydata;
+}
+
+static int match_item(void* entrydata, void* matchdata)
+{
+    return (entrydata == matchdata)? LU_IT_MATCH: LU_IT_NOT_MATCH;
+}
+
+static LUHandler* create_lu(const LUBackend* backend, int capacity)
+{
+    if (backend->isKeyed) {
+        return lu_create_keyed_list(backend->type, item_key);
+    }
+    if (backend->isRing) {
+        return lu_create_ring(backend->type, capacity);
+    }
+    return lu_create_list(backend->type);
+}
+
+/*
+    single thread adds items then pops them, ring holds all items
+*/
+static void bench_listutil_single(const LUBackend* backend, int items)
+{
+    LUHandler* hdl = create_lu(backend, items);
+    void** values = (void**) malloc(items * sizeof(void*));
+    LUNode* nodes = NULL; // embedded in items of intrusive list
+    void* value;
+    unsigned int seed = 1;
+    int64_t elapsed;
+    int i, lookups;
+
+    for (i = 0; i < items; i++) {
+        // distinct keys for keyed list
+        values[i] = (void*) (intptr_t) (backend->isPriority? rand_r(&seed) + 1: i + 1);
+    }
+    if (backend->type & LU_TYPE_INTRUSIVE) {
+        nodes = (LUNode*) calloc(items, sizeof(LUNode));
+    }
+    elapsed = now_ns();
+    for (i = 0; i < items; i++) {
+        if (nodes) {
+            lu_add_node(hdl, &nodes[i], values[i]);
+        } else if (backend->isStack) {
+            lu_push(hdl, values[i]);
+        } else {
+            lu_add(hdl, values[i]);
+        }
+    }
+    elapsed = now_ns() - elapsed;
+    print_result("listutil", backend->name, 1, items, "add", rate(items, elapsed), "ops/s");
+
+    if (backend->type == LU_TYPE_LIST) {
+        // random items, keyed list looks up all of them
+        lookups = (backend->isKeyed || items < BENCH_FIND_LOOKUPS)? items: BENCH_FIND_LOOKUPS;
+        elapsed = now_ns();
+        for (i = 0; i < lookups; i++) {
+            value = values[rand_r(&seed) % items];
+            if ((backend->isKeyed? lu_find_key(hdl, item_key(value)): lu_find(hdl, match_item, value)) != value) {
+                fprintf(stderr, "%s: item %p not found\n", backend->name, value);
+            }
+        }
+        elapsed = now_ns() - elapsed;
+        print_result("listutil", backend->name, 1, items, "find", rate(lookups, elapsed), "ops/s");
+    }
+
+    elapsed = now_ns();
+    for (i = 0; i < items; i++) {
+        lu_pop(hdl);
+    }
+    elapsed = now_ns() - elapsed;
+    print_result("listutil", backend->name, 1, items, "pop", rate(items, elapsed), "ops/s");
+    lu_release_list(hdl);
+    free(nodes);
+    free(values);
+}
+
+/*
+    threads producers and threads consumers pass items through the list,
+    consumers stop when producers are done and the list is drained
+*/
+static void bench_listutil(const LUBackend* backend, int threads, int items)
+{
+    BenchThread* args;
+    pthread_t* tids;
+    LUHandler* hdl;
+    int64_t elapsed;
+    int i, consumed = 0;
+
+    if (backend->isSpsc && threads > 1) {
+        return;
+    }
+    if (threads == 1) {
+        bench_listutil_single(backend, items);
+    }
+    if (backend->isKeyed || (backend->type & LU_TYPE_INTRUSIVE)) {
+        return; // producers add the same items
+    }
+
+    hdl = create_lu(backend, BENCH_RING_CAPACITY);
+    args = (BenchThread*) calloc(threads * 2, sizeof(BenchThread));
+    tids = (pthread_t*) malloc(threads * 2 * sizeof(pthread_t));
+    pthread_barrier_init(&benchBarrier, NULL, threads * 2 + 1);
+    for (i = 0; i < threads * 2; i++) {
+        args[i].lu = hdl;
+        args[i].luBackend = backend;
+        args[i].index = i;
+        // producers are args[0..threads-1], consumers are the others
+        args[i].count = i < threads? items / threads + (i < items % threads? 1: 0): 0;
+        pthread_create(&tids[i], NULL, i < threads? thread_produce: thread_consume, &args[i]);
+    }
+    pthread_barrier_wait(&benchBarrier);
+    for (i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    lu_close(hdl);
+    for (i = threads; i < threads * 2; i++) {
+        pthread_join(tids[i], NULL);
+        consumed += args[i].count;
+    }
+    elapsed = threads_elapsed(args, threads * 2);
+    pthread_barrier_destroy(&benchBarrier);
+    if (consumed != items) {
+        fprintf(stderr, "%s: %d items lost\n", backend->name, items - consumed);
+    }
+    print_result("listutil", backend->name, threads, items, "pipeline", rate(items, elapsed), "msgs/s");
+
+    free(tids);
+    free(args);
+    lu_release_list(hdl);
+}
+
+//////////////////////////////////////////////////////////////
+// Executor benchmark
+//////////////////////////////////////////////////////////////
+/*
+    the same jobs run by a pool of threads sharing one LU_TYPE_BLOCK_QUEUE,
+    or by the work-stealing executor
+    job data is depth + 1 in fork test, a job of depth d submits two jobs
+    of depth d - 1, and 1 in flat test
+*/
+typedef struct {
+    LUHandler* queue; // shared queue pool, NULL for executor
+    EXExecutor* exec;
+    int target; // total jobs
+    volatile int done;
+    int64_t endTime; // nsec, the last job done
+} BenchJobs;
+
+static volatile unsigned int jobSink;
+
+static void run_job(BenchJobs* jobs, intptr_t depth);
+
+static void job_func(void* jobctx, void* jobdata)
+{
+    run_job((BenchJobs*) jobctx, (intptr_t) jobdata);
+}
+
+static void submit_job(BenchJobs* jobs, intptr_t depth)
+{
+    if (jobs->queue) {
+        lu_add(jobs->queue, (void*) depth);
+    } else {
+        ex_submit(jobs->exec, job_func, jobs, (void*) depth);
+    }
+}
+
+static void run_job(BenchJobs* jobs, intptr_t depth)
+{
+    unsigned int x = (unsigned int) depth;
+    int i;
+
+    for (i = 0; i < BENCH_JOB_WORK; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    jobSink = x;
+    if (depth > 1) {
+        submit_job(jobs, depth - 1);
+        submit_job(jobs, depth - 1);
+    }
+    if (__sync_add_and_fetch(&jobs->done, 1) == jobs->target) {
+        jobs->endTime = now_ns();
+        if (jobs->queue) {
+            lu_close(jobs->queue); // pool threads leave
+        }
+    }
+}
+
+static void* thread_pool(void* param)
+{
+    BenchJobs* jobs = (BenchJobs*) param;
+    void* data;
+
+    while ((data = lu_dequeue(jobs->queue))) {
+        run_job(jobs, (intptr_t) data);
+    }
+    return NULL;
+}
+
+/*
+    run jobs in threads of queue pool or executor, return nsec from the
+    first submit to the last job done
+    fork:
+        1 for a binary tree of jobs submitted by jobs, 0 for flat jobs
+        submitted by main thread
+*/
+static int64_t run_jobs(int useExecutor, int threads, int items, int fork, int* ran)
+{
+    BenchJobs jobs;
+    pthread_t* tids = NULL;
+    int64_t start;
+    int depth = 0, i;
+
+    memset(&jobs, 0, sizeof(jobs));
+    if (fork) {
+        while ((2 << (depth + 1)) - 1 <= items) {
+            depth++;
+        }
+        jobs.target = (2 << depth) - 1; // depth + 1 levels
+    } else {
+        jobs.target = items;
+    }
+    if (useExecutor) {
+        jobs.exec = ex_create_executor(threads, NULL, 0);
+    } else {
+        jobs.queue = lu_create_list(LU_TYPE_BLOCK_QUEUE);
+        tids = (pthread_t*) malloc(threads * sizeof(pthread_t));
+        for (i = 0; i < threads; i++) {
+            pthread_create(&tids[i], NULL, thread_pool, &jobs);
+        }
+    }
+
+    start = now_ns();
+    if (fork) {
+        submit_job(&jobs, depth + 1);
+    } else {
+        for (i = 0; i < items; i++) {
+            submit_job(&jobs, 1);
+        }
+    }
+
+    if (useExecutor) {
+        ex_release_executor(jobs.exec); // runs all jobs first
+    } else {
+        for (i = 0; i < threads; i++) {
+            pthread_join(tids[i], NULL);
+        }
+        lu_release_list(jobs.queue);
+        free(tids);
+    }
+    *ran = jobs.done;
+    return jobs.endTime - start;
+}
+
+/*
+    jobs/s of flat jobs from one producer, and of jobs forking jobs
+*/
+static void bench_executor(int threads, int items)
+{
+    const char* names[] = { "block_queue", "executor" };
+    int64_t elapsed;
+    int useExecutor, ran;
+
+    for (useExecutor = 0; useExecutor < 2; useExecutor++) {
+        elapsed = run_jobs(useExecutor, threads, items, 0, &ran);
+        print_result("executor", names[useExecutor], threads, ran, "flat", rate(ran, elapsed), "jobs/s");
+        elapsed = run_jobs(useExecutor, threads, items, 1, &ran);
+        print_result("executor", names[useExecutor], threads, ran, "fork", rate(ran, elapsed), "jobs/s");
+    }
+}
+
+//////////////////////////////////////////////////////////////
+// Scheduler feature benchmark
+//////////////////////////////////////////////////////////////
+/*
+    add items far timers one by one or by tl_add_tasks_batch()
+*/
+static void bench_batch(int batch, int items)
+{
+    TLTaskSpec* specs = (TLTaskSpec*) malloc(items * sizeof(TLTaskSpec));
+    TaskListHandler* hdl = tl_create_handler();
+    int64_t base, elapsed;
+    int i;
+
+    tl_start_task_loop_thread(hdl);
+    base = now_wall_ms() + BENCH_FAR_TIMEOUT;
+    for (i = 0; i < items; i++) {
+        specs[i].abstime = base + i % BENCH_SLACK_SPAN;
+        specs[i].taskFunc = task_nop;
+        specs[i].taskdata = NULL;
+    }
+    elapsed = now_ns();
+    if (batch) {
+        tl_add_tasks_batch(hdl, specs, items, NULL);
+    } else {
+        for (i = 0; i < items; i++) {
+            tl_add_task_abstime(hdl, specs[i].abstime, specs[i].taskFunc, specs[i].taskdata);
+        }
+    }
+    elapsed = now_ns() - elapsed;
+    print_result("scheduler", batch? "batch": "single", 1, items, "insert", rate(items, elapsed), "ops/s");
+    tl_release_handler(hdl);
+    free(specs);
+}
+
+/*
+    add and remove items tasks/entries one by one, most of the cost is
+    allocating and freeing task/entry memory
+*/
+static void bench_churn(int reserve, int items)
+{
+    TaskListHandler* hdl = tl_create_handler();
+    LUHandler* list = lu_create_list(LU_TYPE_NONBLOCK_QUEUE);
+    TLTaskId taskId;
+    int64_t elapsed;
+    int i;
+
+    if (reserve) {
+        tl_reserve_tasks(hdl, reserve);
+        lu_reserve_entries(list, reserve);
+    }
+    elapsed = now_ns();
+    for (i = 0; i < items; i++) {
+        tl_add_task_ex(hdl, BENCH_FAR_TIMEOUT, task_nop, NULL, &taskId);
+        tl_cancel_task(hdl, taskId);
+    }
+    elapsed = now_ns() - elapsed;
+    print_result("scheduler", reserve? "task_reserved": "task", 1, items, "add_cancel", rate(items, elapsed), "ops/s");
+    elapsed = now_ns();
+    for (i = 0; i < items; i++) {
+        lu_enqueue(list, list);
+        lu_dequeue(list);
+    }
+    elapsed = now_ns() - elapsed;
+    print_result("scheduler", reserve? "entry_reserved": "entry", 1, items, "add_pop", rate(items, elapsed), "ops/s");
+    lu_release_list(list);
+    tl_release_handler(hdl);
+}
+
+/*
+    one thread adds and pops items entries round robin over lists, like a
+    loop thread feeding several queues
+*/
+static void bench_lists(int listCount, int items)
+{
+    LUHandler** lists = (LUHandler**) malloc(listCount * sizeof(LUHandler*));
+    int64_t elapsed;
+    char name[32];
+    int i;
+
+    snprintf(name, sizeof(name), "lists_%d", listCount);
+    for (i = 0; i < listCount; i++) {
+        lists[i] = lu_create_list(LU_TYPE_NONBLOCK_QUEUE);
+    }
+    elapsed = now_ns();
+    for (i = 0; i < items; i++) {
+        lu_enqueue(lists[i % listCount], lists);
+        lu_dequeue(lists[i % listCount]);
+    }
+    elapsed = now_ns() - elapsed;
+    print_result("scheduler", name, 1, items, "add_pop", rate(items, elapsed), "ops/s");
+    for (i = 0; i < listCount; i++) {
+        lu_release_list(lists[i]);
+    }
+    free(lists);
+}
+
+/*
+    insert throughput with stats disabled or enabled
+*/
+static void bench_stats(int enable, int items)
+{
+    BenchThread arg;
+    TLStats stats;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.tl = tl_create_handler();
+    arg.count = items;
+    arg.taskIds = (TLTaskId*) malloc(items * sizeof(TLTaskId));
+    if (enable) {
+        tl_enable_stats(arg.tl);
+    }
+    tl_start_task_loop_thread(arg.tl);
+    print_result("scheduler", enable? "stats_on": "stats_off", 1, items, "insert",
+                 rate(items, run_threads(thread_insert, &arg, 1)), "ops/s");
+    if (enable && tl_get_stats(arg.tl, &stats) == 0) {
+        print_result("scheduler", "stats_on", 1, items, "lock_contended", stats.lockContended, "count");
+    }
+    tl_release_handler(arg.tl);
+    free(arg.taskIds);
+}
+
+/*
+    timers spread over BENCH_SLACK_SPAN, loop wakeups and lateness with
+    timer slack
+*/
+static void bench_slack(int64_t slack)
+{
+    TaskListHandler* hdl = tl_create_handler();
+    int64_t* dues = (int64_t*) malloc(BENCH_SLACK_TIMERS * sizeof(int64_t));
+    unsigned int seed = 1;
+    uint64_t wakeups;
+    int64_t elapsed, timeout;
+    char name[32];
+    int i;
+
+    snprintf(name, sizeof(name), "slack_%" PRId64 "us", slack);
+    tl_set_timer_slack(hdl, slack);
+    lateValues = (int64_t*) malloc(BENCH_SLACK_TIMERS * sizeof(int64_t));
+    lateCount = 0;
+    firedCount = 0;
+    tl_start_task_loop_thread(hdl);
+    wakeups = tl_get_wakeup_count(hdl);
+    elapsed = now_ns();
+    for (i = 0; i < BENCH_SLACK_TIMERS; i++) {
+        timeout = BENCH_LATE_DELAY + rand_r(&seed) % (BENCH_SLACK_SPAN * 1000);
+        dues[i] = now_us() + timeout;
+        tl_add_task_us(hdl, timeout, task_late, &dues[i]);
+    }
+    wait_fired(BENCH_SLACK_TIMERS);
+    elapsed = now_ns() - elapsed;
+    wakeups = tl_get_wakeup_count(hdl) - wakeups;
+    qsort(lateValues, BENCH_SLACK_TIMERS, sizeof(int64_t), compare_int64);
+    print_result("scheduler", name, 1, BENCH_SLACK_TIMERS, "wakeups", rate((int) wakeups, elapsed), "1/s");
+    print_result("scheduler", name, 1, BENCH_SLACK_TIMERS, "late_p99", lateValues[(int) (BENCH_SLACK_TIMERS * 0.99)], "us");
+    print_result("scheduler", name, 1, BENCH_SLACK_TIMERS, "late_max", lateValues[BENCH_SLACK_TIMERS - 1], "us");
+    free(lateValues);
+    lateValues = NULL;
+    tl_release_handler(hdl);
+    free(dues);
+}
+
+static int budgetInversions;
+static int64_t budgetLastAbstime;
+static int64_t budgetUrgentMax;
+
+/*
+    data:
+        the abstime of task, fires out of deadline order are counted
+*/
+static void* task_order(TaskListHandler* hdl, void *data)
+{
+    int64_t abstime = *(int64_t*) data;
+    int64_t end = now_us() + 20; // busy 20us, so loop falls behind
+
+    // only called in loop thread
+    if (abstime < budgetLastAbstime) {
+        budgetInversions++;
+    }
+    budgetLastAbstime = abstime;
+    while (now_us() < end);
+    __sync_fetch_and_add(&firedCount, 1);
+    return NULL;
+}
+
+/*
+    data:
+        the time task was added, usec of monotonic clock
+*/
+static void* task_urgent(TaskListHandler* hdl, void *data)
+{
+    int64_t late = now_us() - *(int64_t*) data;
+
+    if (late > budgetUrgentMax) {
+        budgetUrgentMax = late;
+    }
+    __sync_fetch_and_add(&firedCount, 1);
+    return NULL;
+}
+
+/*
+    fire busy timers with shuffled deadlines at once, count the fires out
+    of deadline order, and add overdue tasks while the loop is behind,
+    measure how long they wait with or without run budget
+*/
+static void bench_budget(const TLBackend* backend, int maxTasks)
+{
+    TaskListHandler* hdl = tl_create_handler_with_type(backend->type);
+    int64_t* abstimes = (int64_t*) malloc(BENCH_BUDGET_TASKS * sizeof(int64_t));
+    int64_t addTimes[BENCH_BUDGET_URGENT];
+    unsigned int seed = 1;
+    int64_t base;
+    char name[32];
+    int i;
+
+    snprintf(name, sizeof(name), "%s_budget_%d", backend->name, maxTasks);
+    firedCount = 0;
+    budgetInversions = 0;
+    budgetLastAbstime = 0;
+    budgetUrgentMax = 0;
+    tl_set_run_budget(hdl, maxTasks, 0);
+    base = now_wall_ms() + 200;
+    for (i = 0; i < BENCH_BUDGET_TASKS; i++) {
+        abstimes[i] = base + rand_r(&seed) % BENCH_BUDGET_SPAN;
+        tl_add_task_abstime(hdl, abstimes[i], task_order, &abstimes[i]);
+    }
+    tl_start_task_loop_thread(hdl);
+    // wait until all deadlines passed and the loop is busy
+    usleep((base + BENCH_BUDGET_SPAN - now_wall_ms() + 10) * 1000);
+    for (i = 0; i < BENCH_BUDGET_URGENT; i++) {
+        addTimes[i] = now_us();
+        // due before all burst tasks
+        tl_add_task_abstime(hdl, base - 1, task_urgent, &addTimes[i]);
+        usleep(5000);
+    }
+    wait_fired(BENCH_BUDGET_TASKS + BENCH_BUDGET_URGENT);
+    print_result("scheduler", name, 1, BENCH_BUDGET_TASKS, "out_of_order", budgetInversions, "count");
+    print_result("scheduler", name, 1, BENCH_BUDGET_TASKS, "urgent_late_max", budgetUrgentMax, "us");
+    tl_release_handler(hdl);
+    free(abstimes);
+}
+
+static int64_t* blockDues; // due time of blocking test tasks
+
+/*
+    data:
+        due time of task in blockDues, every 10th task blocks
+*/
+static void* task_block(TaskListHandler* hdl, void *data)
+{
+    int64_t* due = (int64_t*) data;
+    int index = __sync_fetch_and_add(&lateCount, 1);
+
+    // may be called in worker threads
+    lateValues[index] = now_us() - *due;
+    if ((due - blockDues) % 10 == 0) {
+        usleep(50000);
+    }
+    __sync_fetch_and_add(&firedCount, 1);
+    return NULL;
+}
+
+/*
+    lateness of tasks while some callbacks block, run in loop thread or
+    in worker threads
+*/
+static void bench_blocking(int workers)
+{
+    TaskListHandler* hdl = tl_create_handler();
+    int64_t* dues = (int64_t*) malloc(BENCH_BLOCK_TASKS * sizeof(int64_t));
+    char name[32];
+    int i;
+
+    snprintf(name, sizeof(name), "workers_%d", workers);
+    blockDues = dues;
+    tl_set_worker_threads(hdl, workers, NULL, 0);
+    lateValues = (int64_t*) malloc(BENCH_BLOCK_TASKS * sizeof(int64_t));
+    lateCount = 0;
+    firedCount = 0;
+    for (i = 0; i < BENCH_BLOCK_TASKS; i++) {
+        dues[i] = now_us() + BENCH_LATE_DELAY + i * 5000;
+        tl_add_task_us(hdl, dues[i] - now_us(), task_block, &dues[i]);
+    }
+    tl_start_task_loop_thread(hdl);
+    wait_fired(BENCH_BLOCK_TASKS);
+    qsort(lateValues, BENCH_BLOCK_TASKS, sizeof(int64_t), compare_int64);
+    print_result("scheduler", name, workers, BENCH_BLOCK_TASKS, "late_p50", lateValues[BENCH_BLOCK_TASKS / 2], "us");
+    print_result("scheduler", name, workers, BENCH_BLOCK_TASKS, "late_max", lateValues[BENCH_BLOCK_TASKS - 1], "us");
+    free(lateValues);
+    lateValues = NULL;
+    tl_release_handler(hdl);
+    blockDues = NULL;
+    free(dues);
+}
+
+static void* thread_blocked_pop(void* param)
+{
+    return lu_dequeue((LUHandler*) param);
+}
+
+/*
+    release lists with a consumer blocked in lu_dequeue()
+*/
+static void bench_release(void)
+{
+    LUHandler** lists = (LUHandler**) malloc(BENCH_RELEASE_LISTS * sizeof(LUHandler*));
+    pthread_t* consumers = (pthread_t*) malloc(BENCH_RELEASE_LISTS * sizeof(pthread_t));
+    int64_t elapsed;
+    int i;
+
+    for (i = 0; i < BENCH_RELEASE_LISTS; i++) {
+        lists[i] = lu_create_list(LU_TYPE_BLOCK_QUEUE);
+        pthread_create(&consumers[i], NULL, thread_blocked_pop, lists[i]);
+    }
+    usleep(100000); // consumers are blocked
+    elapsed = now_ns();
+    for (i = 0; i < BENCH_RELEASE_LISTS; i++) {
+        lu_release_list(lists[i]);
+    }
+    elapsed = now_ns() - elapsed;
+    for (i = 0; i < BENCH_RELEASE_LISTS; i++) {
+        pthread_join(consumers[i], NULL);
+    }
+    print_result("scheduler", "block_queue", BENCH_RELEASE_LISTS, BENCH_RELEASE_LISTS, "release_blocked",
+                 elapsed / 1000.0 / BENCH_RELEASE_LISTS, "us");
+    free(consumers);
+    free(lists);
+}
+
+/*
+    batch add, allocation churn, many lists per thread and stats cost for
+    items tasks
+*/
+static void bench_scheduler(int items)
+{
+    bench_batch(0, items);
+    bench_batch(1, items);
+    bench_churn(0, items);
+    bench_churn(BENCH_RESERVE, items);
+    bench_lists(1, items);
+    bench_lists(16, items);
+    bench_stats(0, items);
+    bench_stats(1, items);
+}
+
+/*
+    tests bound to wall time, run once with fixed counts
+*/
+static void bench_scheduler_timing(void)
+{
+    int b;
+
+    bench_slack(0);
+    bench_slack(10000);
+    for (b = 0; b < sizeof(tlBackends) / sizeof(tlBackends[0]); b++) {
+        if (!tlBackends[b].shards) {
+            bench_budget(&tlBackends[b], 0);
+            bench_budget(&tlBackends[b], 256);
+        }
+    }
+    bench_blocking(0);
+    bench_blocking(4);
+    bench_release();
+}
+
+int main(int argc, char* argv[])
+{
+    int threads[BENCH_MAX_VALUES] = { 1, 4, 16, 64 };
+    int items[BENCH_MAX_VALUES] = { 1000, 10000, 100000, 1000000 };
+    int threadCount = 4;
+    int itemCount = 4;
+    const char* suite = NULL;
+    int opt, b, t, n;
+
+    while ((opt = getopt(argc, argv, "t:n:s:")) != -1) {
+        switch (opt) {
+        case 't':
+            threadCount = parse_list(optarg, threads);
+            break;
+        case 'n':
+            itemCount = parse_list(optarg, items);
+            break;
+        case 's':
+            suite = optarg;
+            break;
+        default:
+            threadCount = 0;
+            break;
+        }
+        if (!threadCount || !itemCount) {
+            fprintf(stderr, "usage: %s [-t threads,...] [-n items,...] [-s tasklist|listutil|executor|scheduler]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("# tlbench cpus=%ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("suite,backend,threads,items,metric,value,unit\n");
+    if (!suite || strcmp(suite, "tasklist") == 0) {
+        for (b = 0; b < sizeof(tlBackends) / sizeof(tlBackends[0]); b++) {
+            for (t = 0; t < threadCount; t++) {
+                for (n = 0; n < itemCount; n++) {
+                    bench_tasklist(&tlBackends[b], threads[t], items[n]);
+                }
+            }
+        }
+    }
+    if (!suite || strcmp(suite, "listutil") == 0) {
+        for (b = 0; b < sizeof(luBackends) / sizeof(luBackends[0]); b++) {
+            for (t = 0; t < threadCount; t++) {
+                for (n = 0; n < itemCount; n++) {
+                    bench_listutil(&luBackends[b], threads[t], items[n]);
+                }
+            }
+        }
+    }
+    if (!suite || strcmp(suite, "executor") == 0) {
+        for (t = 0; t < threadCount; t++) {
+            for (n = 0; n < itemCount; n++) {
+                bench_executor(threads[t], items[n]);
+            }
+        }
+    }
+    if (!suite || strcmp(suite, "scheduler") == 0) {
+        for (n = 0; n < itemCount; n++) {
+            bench_scheduler(items[n]);
+        }
+        bench_scheduler_timing();
+    }
+    return 0;
+}
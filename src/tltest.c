@@ -2,11 +2,16 @@
 #include "log.h"
 #include "tasklist.h"
 #include "listutil.h"
+#include "executor.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sched.h>
+#include <poll.h>
+#include <inttypes.h>
+#include <time.h>
 
 typedef struct TestDataST {
     int id;
@@ -15,6 +20,15 @@ typedef struct TestDataST {
 
 TestData testdata[4];
 
+static int fails; // number of failed CHECK(), main returns 1 while it is not 0
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            LOGE("CHECK(%s) failed at line %d", #cond, __LINE__); \
+            fails++; \
+        } \
+    } while (0)
+
 /*
     Function for test tl_iterator_task()
 
@@ -171,6 +185,65 @@ static void* task_print_string(TaskListHandler* hdl, void *data)
     return NULL;
 }
 
+/*
+    Function for test tl_add_periodic_task()
+*/
+static void* task_heartbeat(TaskListHandler* hdl, void *data)
+{
+    TestData* testdata = (TestData*) data;
+
+    testdata->id++;
+    LOGI("task_heartbeat, count=%d, overrun=%" PRId64, testdata->id, tl_get_task_overrun());
+
+    return NULL;
+}
+
+/*
+    Function for test tl_cancel_task_sync()
+*/
+static void* task_slow(TaskListHandler* hdl, void *data)
+{
+    TestData* testdata = (TestData*) data;
+
+    LOGI("task_slow, id=%d, start", testdata->id);
+    sleep(1);
+    LOGI("task_slow, id=%d, end", testdata->id);
+
+    return NULL;
+}
+
+/*
+    run tasks in this thread by poll mode, without loop thread
+*/
+static void try_poll_mode(void)
+{
+    TaskListHandler* hdl = tl_create_handler();
+    TestData polldata[3];
+    struct pollfd pfd;
+    int i;
+
+    memset(polldata, 0, sizeof(polldata));
+    pfd.fd = tl_get_poll_fd(hdl);
+    pfd.events = POLLIN;
+    if (pfd.fd < 0) {
+        LOGI("poll mode is not supported");
+        tl_release_handler(hdl);
+        return;
+    }
+    CHECK(tl_set_worker_threads(hdl, 2, NULL, 0) == -1); // poll mode runs tasks in caller
+    for (i = 0; i < 3; i++) {
+        polldata[i].id = 30 + i;
+        tl_add_task(hdl, 100 * (i + 1), task_print_string, &polldata[i]);
+    }
+    while (!tl_is_empty(hdl)) {
+        if (poll(&pfd, 1, 1000) > 0) {
+            LOGI("poll fd is readable, process expired tasks");
+            tl_process_expired(hdl);
+        }
+    }
+    tl_release_handler(hdl);
+}
+
 static void* task_find(TaskListHandler* hdl, void *data)
 {
 	TestData matchdata;
@@ -185,6 +258,608 @@ static void* task_find(TaskListHandler* hdl, void *data)
 	return NULL;
 }
 
+/*
+    LUCompareFunc, smaller id pops first
+*/
+static int lucb_compare_my_data(void* entrydata1, void* entrydata2)
+{
+    return ((TestData*) entrydata1)->id - ((TestData*) entrydata2)->id;
+}
+
+/*
+    usec of monotonic clock
+*/
+static int64_t get_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+    consumer blocked until lu_close()/lu_release_list(), returns what lu_pop() returns
+*/
+static void* thread_pop_closed(void* args)
+{
+    return lu_pop((LUHandler*) args);
+}
+
+#define RING_ITEMS	10000 // items of each producer, fit in low 16 bits
+
+typedef struct RingDataST {
+    LUHandler* ring;
+    intptr_t producer; // high bits of each item
+} RingData;
+
+/*
+    enqueue producer << 16 | 1..RING_ITEMS in order, retry while ring is full
+*/
+static void* thread_ring_producer(void* args)
+{
+    RingData* ringdata = (RingData*) args;
+    intptr_t i;
+
+    for (i = 1; i <= RING_ITEMS; i++) {
+        while (lu_enqueue(ringdata->ring, (void*) ((ringdata->producer << 16) | i)) != 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/*
+    LUKeyFunc, id is the key
+*/
+static uint64_t lucb_key_my_data(void* entrydata)
+{
+    return (uint64_t) ((TestData*) entrydata)->id;
+}
+
+typedef struct NodeDataST {
+    int id;
+    LUNode node; // owned by this struct, linked by lu_add_node()
+} NodeData;
+
+/*
+    check LUHandler of other types, failed checks are counted in fails
+*/
+static void try_lists(void)
+{
+    LUHandler* list;
+    TestData prioritydata[5];
+    TestData keydata[4];
+    TestData dupdata;
+    NodeData nodedata[3];
+    NodeData* nodefound;
+    LUNode* node;
+    TestData matchdata;
+    TestData* founddata;
+    int ringTypes[] = { LU_TYPE_BLOCK_RING_SPSC, LU_TYPE_BLOCK_RING_MPMC };
+    RingData ringdata[2];
+    pthread_t producers[2];
+    intptr_t lastItems[2];
+    intptr_t item;
+    void* items[8];
+    void* popped;
+    pthread_t consumer;
+    int64_t start;
+    int i, t, lastId, popCount, disorder;
+
+    //////////////////////////////////////////////////////////////
+    // Try Priority List
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Priority List ##########");
+    // pops by id, lu_find()/lu_remove() work on heap
+    list = lu_create_priority(LU_TYPE_PRIORITY, lucb_compare_my_data);
+    memset(prioritydata, 0, sizeof(prioritydata));
+    memset(&matchdata, 0, sizeof(matchdata));
+    for (i = 0; i < 5; i++) {
+        prioritydata[i].id = 41 + (i * 3) % 5; // 41 44 42 45 43
+        lu_add(list, &prioritydata[i]);
+    }
+    lu_dump_list("priority list, added 41 44 42 45 43", list, dump_my_data);
+
+    matchdata.id = 44;
+    founddata = lu_find(list, lucb_match_my_data, &matchdata);
+    CHECK(founddata == &prioritydata[1]);
+    matchdata.id = 42;
+    founddata = lu_remove(list, lucb_match_my_data, &matchdata);
+    CHECK(founddata == &prioritydata[2]);
+
+    lastId = 0;
+    popCount = 0;
+    while ((founddata = (TestData*) lu_pop(list)) != NULL) {
+        LOGI("lu_pop(), founddata.id=%d", founddata->id);
+        CHECK(founddata->id > lastId && founddata->id != 42);
+        lastId = founddata->id;
+        popCount++;
+    }
+    CHECK(popCount == 4);
+
+    // clear and reuse
+    lu_add(list, &prioritydata[0]);
+    lu_add(list, &prioritydata[1]);
+    lu_clear(list);
+    CHECK(lu_is_empty(list));
+    lu_add(list, &prioritydata[3]);
+    lu_add(list, &prioritydata[4]);
+    founddata = (TestData*) lu_pop(list);
+    CHECK(founddata == &prioritydata[4]);
+    founddata = (TestData*) lu_pop(list);
+    CHECK(founddata == &prioritydata[3] && lu_is_empty(list));
+    lu_release_list(list);
+
+    //////////////////////////////////////////////////////////////
+    // Try Keyed List
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Keyed List ##########");
+    // finds and removes by id, index follows lu_dequeue()/lu_remove()
+    list = lu_create_keyed_list(LU_TYPE_NONBLOCK_QUEUE, lucb_key_my_data);
+    memset(keydata, 0, sizeof(keydata));
+    memset(&dupdata, 0, sizeof(dupdata));
+    for (i = 0; i < 4; i++) {
+        keydata[i].id = 50 + i;
+        lu_enqueue(list, &keydata[i]);
+    }
+    lu_dump_list("keyed list, added 50~53", list, dump_my_data);
+    CHECK(lu_find_key(list, 51) == &keydata[1]);
+    CHECK(lu_find_key(list, 99) == NULL);
+
+    dupdata.id = 51;
+    CHECK(lu_enqueue(list, &dupdata) == -1);
+    CHECK(lu_find_key(list, 51) == &keydata[1]);
+    CHECK(lu_remove_key(list, 52) == &keydata[2]);
+    CHECK(lu_find_key(list, 52) == NULL);
+
+    // removed by match, index must drop it too
+    matchdata.id = 53;
+    CHECK(lu_remove(list, lucb_match_my_data, &matchdata) == &keydata[3]);
+    CHECK(lu_find_key(list, 53) == NULL);
+
+    popCount = 0;
+    while ((founddata = (TestData*) lu_dequeue(list)) != NULL) {
+        CHECK(founddata == &keydata[popCount]);
+        CHECK(lu_find_key(list, founddata->id) == NULL);
+        popCount++;
+    }
+    CHECK(popCount == 2);
+    CHECK(lu_enqueue(list, &dupdata) == 0);
+    lu_release_list(list);
+
+    //////////////////////////////////////////////////////////////
+    // Try Intrusive List
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Intrusive List ##########");
+    // links nodes of caller, release doesn't free them
+    list = lu_create_list(LU_TYPE_NONBLOCK_QUEUE | LU_TYPE_INTRUSIVE);
+    memset(nodedata, 0, sizeof(nodedata));
+    for (i = 0; i < 3; i++) {
+        nodedata[i].id = 60 + i;
+        lu_add_node(list, &nodedata[i].node, &nodedata[i]);
+    }
+    CHECK(lu_add(list, &nodedata[0]) == -1); // no LUEntry for intrusive list
+
+    node = lu_pop_node(list);
+    nodefound = node? LU_NODE_ENTRY(node, NodeData, node): NULL;
+    CHECK(nodefound == &nodedata[0] && node->data == &nodedata[0]);
+
+    // popped node is free to link again
+    lu_push_node(list, &nodedata[0].node, &nodedata[0]);
+    lu_remove_node(list, &nodedata[1].node);
+    for (i = 0; (node = lu_pop_node(list)) != NULL; i++) {
+        nodefound = LU_NODE_ENTRY(node, NodeData, node);
+        LOGI("lu_pop_node(), nodefound.id=%d", nodefound->id);
+        CHECK(nodefound == &nodedata[i == 0? 0: 2]);
+    }
+    CHECK(i == 2);
+
+    // release with linked nodes, nodes are still owned by caller
+    for (i = 0; i < 3; i++) {
+        lu_add_node(list, &nodedata[i].node, &nodedata[i]);
+    }
+    lu_release_list(list);
+    for (i = 0; i < 3; i++) {
+        nodedata[i].id += 10;
+        CHECK(nodedata[i].id == 70 + i);
+    }
+
+    //////////////////////////////////////////////////////////////
+    // Try Ring
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Ring ##########");
+    // each producer's items are dequeued in its order, SPSC by one
+    // producer and MPMC by two, small ring makes producers wrap and retry
+    for (t = 0; t < 2; t++) {
+        list = lu_create_ring(ringTypes[t], 64);
+        for (i = 0; i <= t; i++) {
+            ringdata[i].ring = list;
+            ringdata[i].producer = i;
+            lastItems[i] = 0;
+            pthread_create(&producers[i], NULL, thread_ring_producer, &ringdata[i]);
+        }
+        disorder = 0;
+        for (popCount = 0; popCount < (t + 1) * RING_ITEMS; popCount++) {
+            item = (intptr_t) lu_dequeue(list);
+            i = (int) (item >> 16);
+            if (i > t) {
+                disorder++;
+                continue;
+            }
+            disorder += ((item & 0xffff) != (lastItems[i] & 0xffff) + 1);
+            lastItems[i] = item;
+        }
+        for (i = 0; i <= t; i++) {
+            pthread_join(producers[i], NULL);
+        }
+        LOGI("ring type=%d, dequeued %d items, disorder=%d", ringTypes[t], popCount, disorder);
+        CHECK(disorder == 0 && popCount == (t + 1) * RING_ITEMS);
+        CHECK(lu_is_empty(list));
+        lu_release_list(list);
+    }
+
+    //////////////////////////////////////////////////////////////
+    // Try Batch
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Batch ##########");
+    // lu_add_batch() keeps items order, lu_pop_batch() takes at most max
+    list = lu_create_list(LU_TYPE_NONBLOCK_QUEUE);
+    for (i = 0; i < 8; i++) {
+        items[i] = &testdata[i % 4];
+    }
+    CHECK(lu_add_batch(list, items, 8) == 8);
+    memset(items, 0, sizeof(items));
+    CHECK(lu_pop_batch(list, items, 5, 0) == 5);
+    CHECK(items[0] == &testdata[0] && items[4] == &testdata[0]);
+    CHECK(lu_pop_batch(list, items, 5, 0) == 3);
+    CHECK(items[0] == &testdata[1] && items[2] == &testdata[3]);
+    CHECK(lu_pop_batch(list, items, 5, 0) == 0 && lu_is_empty(list));
+    lu_release_list(list);
+
+    // full ring takes the items before the first full slot
+    list = lu_create_ring(LU_TYPE_RING_MPMC, 4);
+    CHECK(lu_add_batch(list, items, 3) == 3);
+    CHECK(lu_add_batch(list, items, 3) == 1);
+    CHECK(lu_pop_batch(list, items, 8, 0) == 4 && lu_is_empty(list));
+    lu_release_list(list);
+
+    //////////////////////////////////////////////////////////////
+    // Try Timed Pop and Close
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Timed Pop and Close ##########");
+    // queue, priority and ring, lu_pop_timed() returns NULL after timeout,
+    // lu_close() wakes up the blocked consumer
+    for (t = 0; t < 3; t++) {
+        if (t == 0) {
+            list = lu_create_list(LU_TYPE_BLOCK_QUEUE);
+        } else if (t == 1) {
+            list = lu_create_priority(LU_TYPE_BLOCK_PRIORITY, lucb_compare_my_data);
+        } else {
+            list = lu_create_ring(LU_TYPE_BLOCK_RING_MPMC, 64);
+        }
+        start = get_us();
+        CHECK(lu_pop_timed(list, 50000) == NULL);
+        CHECK(get_us() - start >= 50000);
+        lu_enqueue(list, &testdata[0]);
+        CHECK(lu_pop_timed(list, 50000) == &testdata[0]);
+
+        pthread_create(&consumer, NULL, thread_pop_closed, list);
+        usleep(50000);
+        lu_close(list);
+        pthread_join(consumer, &popped);
+        CHECK(popped == NULL && lu_is_closed(list));
+        lu_release_list(list);
+    }
+
+    // lu_release_list() wakes up the blocked consumer and waits it leaving
+    list = lu_create_list(LU_TYPE_BLOCK_STACK);
+    pthread_create(&consumer, NULL, thread_pop_closed, list);
+    usleep(50000);
+    lu_release_list(list);
+    pthread_join(consumer, &popped);
+    CHECK(popped == NULL);
+}
+
+typedef struct SnapshotDataST {
+    int count; // tasks seen by callback
+    int idSum;
+    TLTaskId cancelId; // cancelled in callback
+    TestData* adddata; // added in callback, NULL for no change
+} SnapshotData;
+
+/*
+    TLIteratorFunc for tl_iterator_task_snapshot(), runs without listLock,
+    so it can cancel and add tasks of the same handler
+*/
+static int tlcb_snapshot_my_data(TaskListHandler* hdl, void* data, void* itdata)
+{
+    TestData* testdata = (TestData*) data;
+    SnapshotData* snapshot = (SnapshotData*) itdata;
+
+    LOGI("snapshot task id = %d", testdata->id);
+    if (snapshot->count++ == 0 && snapshot->adddata) {
+        tl_cancel_task(hdl, snapshot->cancelId);
+        tl_add_task(hdl, 10000, task_print_string, snapshot->adddata);
+    }
+    snapshot->idSum += testdata->id;
+    return TL_IT_CONTINUE;
+}
+
+#define RUN_LOG_SIZE	16
+
+typedef struct RunLogST {
+    int ids[RUN_LOG_SIZE]; // id of taskdata in run order
+    int64_t times[RUN_LOG_SIZE]; // get_us() when callback runs
+    int count; // atomic, callbacks may run in workers
+} RunLog;
+
+RunLog runlog;
+
+/*
+    record taskdata id and time to runlog
+*/
+static void* task_log_run(TaskListHandler* hdl, void *data)
+{
+    int i = __atomic_fetch_add(&runlog.count, 1, __ATOMIC_SEQ_CST);
+
+    if (i < RUN_LOG_SIZE) {
+        runlog.ids[i] = ((TestData*) data)->id;
+        runlog.times[i] = get_us();
+    }
+    return NULL;
+}
+
+/*
+    EXJobFunc, count jobs in jobctx
+*/
+static void job_count(void* jobctx, void* jobdata)
+{
+    __atomic_add_fetch((int*) jobctx, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+    msec from 1970, for abstime of tasks
+*/
+static int64_t get_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+    check TaskListHandler features on handlers of their own, failed checks
+    are counted in fails
+*/
+static void try_tasks(void)
+{
+    TaskListHandler* hdl;
+    TestData snapdata[4];
+    TLTaskId taskIds[3];
+    SnapshotData snapshot;
+    TLTaskSpec specs[3];
+    TLTaskId batchIds[3];
+    TLTaskId taskId, cancelId;
+    TestData logdata[5];
+    TLStats stats;
+    uint64_t wakeups, lateCount, execCount;
+    struct pollfd pfd;
+    EXExecutor* exec;
+    int jobCount;
+    int shuffle[] = { 3, 0, 4, 1, 2 };
+    int wheelOrder[] = { 0, 1, 3, 2 };
+    int64_t wheelDelays[] = { 100, 300, 600 }; // msec of id 0~2
+    int64_t now;
+    int i;
+
+    //////////////////////////////////////////////////////////////
+    // Try Snapshot
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Snapshot ##########");
+    // sees the tasks pending when it is taken, changes made by callback
+    // show in the next snapshot
+    hdl = tl_create_handler();
+    tl_start_task_loop_thread(hdl);
+    memset(snapdata, 0, sizeof(snapdata));
+    memset(&snapshot, 0, sizeof(snapshot));
+    for (i = 0; i < 3; i++) {
+        snapdata[i].id = 80 + i;
+        tl_add_task_ex(hdl, 10000 + i * 1000, task_print_string, &snapdata[i], &taskIds[i]);
+    }
+    snapdata[3].id = 83;
+    snapshot.cancelId = taskIds[2];
+    snapshot.adddata = &snapdata[3];
+    tl_iterator_task_snapshot(hdl, tlcb_snapshot_my_data, &snapshot);
+    CHECK(snapshot.count == 3 && snapshot.idSum == 80 + 81 + 82);
+
+    // id 82 was cancelled and id 83 was added by callback
+    snapshot.count = 0;
+    snapshot.idSum = 0;
+    snapshot.adddata = NULL;
+    tl_iterator_task_snapshot(hdl, tlcb_snapshot_my_data, &snapshot);
+    CHECK(snapshot.count == 3 && snapshot.idSum == 80 + 81 + 83);
+    tl_release_handler(hdl);
+
+    //////////////////////////////////////////////////////////////
+    // Try Batch Tasks
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Batch Tasks ##########");
+    // each task gets its own id, in specs order
+    hdl = tl_create_handler();
+    now = get_ms();
+    for (i = 0; i < 3; i++) {
+        specs[i].abstime = now + 60000 + i * 1000;
+        specs[i].taskFunc = task_print_string;
+        specs[i].taskdata = &snapdata[i];
+        batchIds[i] = 0;
+    }
+    CHECK(tl_add_tasks_batch(hdl, specs, 3, batchIds) == 0);
+    CHECK(batchIds[0] != 0 && batchIds[1] != 0 && batchIds[2] != 0);
+    CHECK(batchIds[0] != batchIds[1] && batchIds[1] != batchIds[2] && batchIds[0] != batchIds[2]);
+    CHECK(tl_cancel_task(hdl, batchIds[1]) == 0);
+    CHECK(tl_cancel_task(hdl, batchIds[1]) == -1);
+    CHECK(tl_cancel_task(hdl, batchIds[0]) == 0 && tl_cancel_task(hdl, batchIds[2]) == 0);
+    CHECK(tl_is_empty(hdl));
+    tl_release_handler(hdl);
+
+    //////////////////////////////////////////////////////////////
+    // Try Timer Slack
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Timer Slack ##########");
+    // tasks due within 4 msec run in one wakeup with 20 msec slack, never early
+    hdl = tl_create_handler();
+    CHECK(tl_set_timer_slack(hdl, 20000) == 0);
+    memset(logdata, 0, sizeof(logdata));
+    memset(&runlog, 0, sizeof(runlog));
+    now = get_us();
+    for (i = 0; i < 5; i++) {
+        logdata[i].id = i;
+        tl_add_task_us(hdl, 10000 + i * 1000, task_log_run, &logdata[i]);
+    }
+    wakeups = tl_get_wakeup_count(hdl);
+    tl_start_task_loop_thread(hdl);
+    usleep(200000);
+    wakeups = tl_get_wakeup_count(hdl) - wakeups;
+    LOGI("5 tasks run by %" PRIu64 " wakeups", wakeups);
+    CHECK(__atomic_load_n(&runlog.count, __ATOMIC_SEQ_CST) == 5 && wakeups < 5);
+    for (i = 0; i < 5 && i < runlog.count; i++) {
+        CHECK(runlog.times[i] - now >= 10000 + runlog.ids[i] * 1000);
+    }
+    tl_release_handler(hdl);
+
+    //////////////////////////////////////////////////////////////
+    // Try Stats
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Stats ##########");
+    // 4 added, 1 cancelled, 3 fired, every fired task is in both histograms
+    hdl = tl_create_handler();
+    CHECK(tl_get_stats(hdl, &stats) == -1);
+    CHECK(tl_enable_stats(hdl) == 0);
+    tl_start_task_loop_thread(hdl);
+    for (i = 0; i < 3; i++) {
+        tl_add_task(hdl, 1, task_print_string, &logdata[i]);
+    }
+    tl_add_task_ex(hdl, 60000, task_print_string, &logdata[3], &taskId);
+    CHECK(tl_cancel_task(hdl, taskId) == 0);
+    usleep(100000);
+    CHECK(tl_get_stats(hdl, &stats) == 0);
+    lateCount = 0;
+    execCount = 0;
+    for (i = 0; i < TL_STATS_BUCKETS; i++) {
+        lateCount += stats.lateness[i];
+        execCount += stats.execTime[i];
+    }
+    LOGI("stats, adds=%" PRIu64 ", cancels=%" PRIu64 ", fires=%" PRIu64 ", taskCount=%d, maxTaskCount=%d",
+         stats.adds, stats.cancels, stats.fires, stats.taskCount, stats.maxTaskCount);
+    CHECK(stats.adds == 4 && stats.cancels == 1 && stats.fires == 3);
+    CHECK(stats.taskCount == 0 && stats.maxTaskCount >= 1);
+    CHECK(lateCount == 3 && execCount == 3);
+    tl_release_handler(hdl);
+
+    //////////////////////////////////////////////////////////////
+    // Try Run Budget
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Run Budget ##########");
+    // one task per tl_process_expired(), earliest first, poll fd stays readable
+    hdl = tl_create_handler();
+    pfd.fd = tl_get_poll_fd(hdl);
+    pfd.events = POLLIN;
+    if (pfd.fd >= 0) {
+        CHECK(tl_set_run_budget(hdl, 1, 0) == 0);
+        memset(&runlog, 0, sizeof(runlog));
+        now = get_ms();
+        for (i = 2; i >= 0; i--) {
+            tl_add_task_abstime(hdl, now - 30 + i * 10, task_log_run, &logdata[i]);
+        }
+        tl_process_expired(hdl);
+        CHECK(runlog.count == 1 && runlog.ids[0] == 0);
+        CHECK(poll(&pfd, 1, 0) == 1);
+        while (!tl_is_empty(hdl) && poll(&pfd, 1, 1000) > 0) {
+            tl_process_expired(hdl);
+        }
+        CHECK(runlog.count == 3 && runlog.ids[1] == 1 && runlog.ids[2] == 2);
+    } else {
+        LOGI("poll mode is not supported");
+    }
+    tl_release_handler(hdl);
+
+    //////////////////////////////////////////////////////////////
+    // Try Executor
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Executor ##########");
+    // tasks run in executor workers, release of executor runs all jobs
+    exec = ex_create_executor(2, NULL, 0);
+    CHECK(exec != NULL);
+    hdl = tl_create_handler();
+    CHECK(tl_set_executor(hdl, exec) == 0);
+    CHECK(tl_set_worker_threads(hdl, 2, NULL, 0) == -1);
+    tl_start_task_loop_thread(hdl);
+    CHECK(tl_set_executor(hdl, NULL) == -1);
+    memset(&runlog, 0, sizeof(runlog));
+    for (i = 0; i < 5; i++) {
+        tl_add_task(hdl, 1, task_log_run, &logdata[i]);
+    }
+    usleep(100000);
+    CHECK(__atomic_load_n(&runlog.count, __ATOMIC_SEQ_CST) == 5);
+    tl_release_handler(hdl);
+
+    jobCount = 0;
+    for (i = 0; i < 100; i++) {
+        CHECK(ex_submit(exec, job_count, &jobCount, NULL) == 0);
+    }
+    ex_release_executor(exec);
+    CHECK(jobCount == 100);
+
+    //////////////////////////////////////////////////////////////
+    // Try Timing Wheel
+    //////////////////////////////////////////////////////////////
+    LOGI("\n########## Try Timing Wheel ##########");
+    // overdue tasks added in any order run earliest first
+    hdl = tl_create_handler_with_type(TL_TYPE_WHEEL);
+    pfd.fd = tl_get_poll_fd(hdl);
+    pfd.events = POLLIN;
+    if (pfd.fd >= 0) {
+        memset(&runlog, 0, sizeof(runlog));
+        now = get_ms();
+        for (i = 0; i < 5; i++) {
+            tl_add_task_abstime(hdl, now - 50 + shuffle[i] * 10, task_log_run, &logdata[shuffle[i]]);
+        }
+        tl_process_expired(hdl);
+        CHECK(runlog.count == 5 && tl_is_empty(hdl));
+        for (i = 0; i < 5 && i < runlog.count; i++) {
+            CHECK(runlog.ids[i] == i);
+        }
+    } else {
+        LOGI("poll mode is not supported");
+    }
+    tl_release_handler(hdl);
+
+    // tasks beyond the root wheel(256 msec) cascade down and never run early,
+    // id 3 is moved from level 2 to 400 msec, id 4 is cancelled
+    hdl = tl_create_handler_with_type(TL_TYPE_WHEEL);
+    tl_start_task_loop_thread(hdl);
+    memset(&runlog, 0, sizeof(runlog));
+    now = get_us();
+    for (i = 0; i < 3; i++) {
+        tl_add_task(hdl, wheelDelays[i], task_log_run, &logdata[i]);
+    }
+    tl_add_task_ex(hdl, 20000, task_log_run, &logdata[3], &taskId);
+    CHECK(tl_reschedule_task(hdl, taskId, get_ms() + 400) == 0);
+    tl_add_task_ex(hdl, 500, task_log_run, &logdata[4], &cancelId);
+    CHECK(tl_cancel_task(hdl, cancelId) == 0);
+    usleep(800000);
+    CHECK(__atomic_load_n(&runlog.count, __ATOMIC_SEQ_CST) == 4 && tl_is_empty(hdl));
+    for (i = 0; i < 4 && i < runlog.count; i++) {
+        CHECK(runlog.ids[i] == wheelOrder[i]);
+        if (runlog.ids[i] < 3) {
+            CHECK(runlog.times[i] - now >= wheelDelays[runlog.ids[i]] * 1000);
+        }
+    }
+    CHECK(tl_cancel_task(hdl, taskId) == -1 && tl_get_task_state(hdl, taskId) == TL_TASK_DONE);
+    tl_release_handler(hdl);
+}
+
 /*
 int main()
 {
@@ -312,8 +987,19 @@ int main()
 {
     TestData testdata[5];
     TestData matchdata;
+    TestData usdata;
+    TestData beatdata;
+    TLTaskId beatId;
+    int beatCount;
+    TestData slowdata;
+    TLTaskId slowId;
     TestData* founddata;
-    TaskListHandler* hdl = tl_create_handler(19966);
+    TaskListHandler* hdl;
+    TLTaskId taskId;
+    int ret;
+
+
+    hdl = tl_create_handler(19966);
     tl_start_task_loop_thread(hdl);
 
     memset(testdata, 0, sizeof(testdata));
@@ -368,10 +1054,70 @@ int main()
 
     tl_dump_tasks("remove task id by tl_remove_task()", hdl, dump_my_data);
 
-    sleep(6);
+    // try tl_cancel_task & tl_reschedule_task
+    LOGI("add id == 24 with task id, reschedule and cancel it");
+    testdata[4].id = 24;
+    CHECK(tl_add_task_ex(hdl, 4000, task_print_string, &testdata[4], &taskId) == 0);
+    ret = tl_reschedule_task(hdl, taskId, (time(NULL) + 8) * 1000);
+    LOGI("tl_reschedule_task(%" PRIu64 "), ret=%d", taskId, ret);
+    CHECK(ret == 0);
+    ret = tl_cancel_task(hdl, taskId);
+    LOGI("tl_cancel_task(%" PRIu64 "), ret=%d", taskId, ret);
+    CHECK(ret == 0);
+    ret = tl_cancel_task(hdl, taskId);
+    LOGI("tl_cancel_task(%" PRIu64 ") again, ret=%d", taskId, ret);
+    CHECK(ret == -1);
+    CHECK(tl_reschedule_task(hdl, taskId, (time(NULL) + 8) * 1000) == -1);
+
+    // sub-millisecond timer
+    LOGI("add id == 25 with 500 usec timeout");
+    memset(&usdata, 0, sizeof(usdata));
+    usdata.id = 25;
+    tl_add_task_us(hdl, 500, task_print_string, &usdata);
+
+    // periodic task, cancel it after 3 runs
+    LOGI("add heartbeat every 1000 msec");
+    memset(&beatdata, 0, sizeof(beatdata));
+    tl_add_periodic_task_ex(hdl, (int64_t) time(NULL) * 1000 + 500, 1000, task_heartbeat, &beatdata, &beatId);
+
+    sleep(3);
+    ret = tl_cancel_task(hdl, beatId);
+    beatCount = beatdata.id;
+    LOGI("tl_cancel_task(heartbeat), ret=%d, count=%d", ret, beatCount);
+    CHECK(ret == 0 && beatCount >= 2 && beatCount <= 4);
+    sleep(3);
+    CHECK(beatdata.id == beatCount); // not re-armed after cancel
+
+    // cancel a running task, wait until its callback returns
+    LOGI("add id == 26, its callback takes 1 sec");
+    memset(&slowdata, 0, sizeof(slowdata));
+    slowdata.id = 26;
+    tl_add_task_ex(hdl, 0, task_slow, &slowdata, &slowId);
+    usleep(200000);
+    LOGI("tl_get_task_state(%" PRIu64 "), state=%d", slowId, tl_get_task_state(hdl, slowId));
+    CHECK(tl_get_task_state(hdl, slowId) == TL_TASK_RUNNING);
+    ret = tl_cancel_task_sync(hdl, slowId);
+    LOGI("tl_cancel_task_sync(%" PRIu64 "), ret=%d, state=%d", slowId, ret, tl_get_task_state(hdl, slowId));
+    CHECK(ret == -1 && tl_get_task_state(hdl, slowId) == TL_TASK_DONE);
+
+    // pending task is cancelled, its id stays done
+    tl_add_task_ex(hdl, 60000, task_slow, &slowdata, &slowId);
+    CHECK(tl_get_task_state(hdl, slowId) == TL_TASK_PENDING);
+    CHECK(tl_cancel_task_sync(hdl, slowId) == 0);
+    CHECK(tl_get_task_state(hdl, slowId) == TL_TASK_DONE);
+    CHECK(tl_cancel_task_sync(hdl, slowId) == -1);
     tl_release_handler(hdl);
 
+    // task loop in caller's event loop
+    LOGI("add id == 30~32 to handler in poll mode");
+    try_poll_mode();
+
+    // LUHandler of other types, TaskListHandler features
+    try_lists();
+    try_tasks();
+    LOGI("checks done, fails=%d", fails);
+
     uninit_log();
 
-    return 0;
+    return fails? 1: 0;
 }